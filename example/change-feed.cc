@@ -0,0 +1,94 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <thread>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+int main (int argc, char* argv[])
+{
+    Sqlite3 sqlite3;
+
+    int ret = sqlite3.connect("/tmp/testChangeFeed");
+    qInfo() << "ret: " << ret << " msg: " << sqlite3.lastError();
+
+    sqlite3.execute("DROP TABLE IF EXISTS kv;");
+    sqlite3.execute("CREATE TABLE kv (id INTEGER PRIMARY KEY, k TEXT, v TEXT);");
+
+    // SQLite 未启用 preupdate hook 时退回到只订阅 rowid
+    auto feed = sqlite3.subscribeChanges(1024, true);
+    if (!feed) {
+        feed = sqlite3.subscribeChanges(1024, false);
+    }
+
+    std::thread consumer([feed] () {
+        Sqlite3Change change;
+        while (feed->wait(change, 500)) {
+            qInfo() << "change: " << change.op << change.table << change.rowid << change.newRowid
+                    << change.oldValues << change.newValues;
+        }
+        qInfo() << "consumer idle, dropped: " << feed->dropped();
+    });
+
+    sqlite3.execute("INSERT INTO kv (k, v) VALUES ('a', '1'), ('b', '2');");
+
+    // 回滚的变更不会投递
+    sqlite3.execute("BEGIN;");
+    sqlite3.execute("INSERT INTO kv (k, v) VALUES ('rolled', 'back');");
+    sqlite3.execute("ROLLBACK;");
+
+    try {
+        Sqlite3Transaction trans(sqlite3, true);
+        Sqlite3Command cmd(sqlite3, "UPDATE kv SET v = ? WHERE k = ?;");
+        cmd.bind(1, "3");
+        cmd.bind(2, "a");
+        cmd.execute();
+        sqlite3.execute("DELETE FROM kv WHERE k = 'b';");
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    // 失败语句已写入的行与 ROLLBACK TO 撤销的修改不会投递
+    sqlite3.execute("CREATE UNIQUE INDEX kv_k ON kv (k);");
+    sqlite3.execute("BEGIN;");
+    ret = sqlite3.execute("INSERT INTO kv (k, v) VALUES ('c', '4'), ('a', 'dup');");
+    qInfo() << "failed statement: " << ret << " msg: " << sqlite3.lastError();
+    sqlite3.execute("SAVEPOINT sp;");
+    sqlite3.execute("INSERT INTO kv (k, v) VALUES ('undone', '5');");
+    sqlite3.execute("ROLLBACK TO sp;");
+    sqlite3.execute("RELEASE sp;");
+    sqlite3.execute("INSERT INTO kv (k, v) VALUES ('kept', '6');");
+    sqlite3.execute("COMMIT;");
+
+    // OR FAIL 保留冲突之前已写入的行, 自动提交与显式事务中都会投递
+    ret = sqlite3.execute("INSERT OR FAIL INTO kv (k, v) VALUES ('fail-kept', '8'), ('a', 'dup');");
+    qInfo() << "or fail: " << ret;
+    sqlite3.execute("BEGIN;");
+    sqlite3.execute("INSERT OR FAIL INTO kv (k, v) VALUES ('fail-kept-trans', '9'), ('a', 'dup');");
+    sqlite3.execute("COMMIT;");
+
+    // 其它连接持有读锁时 COMMIT 返回 SQLITE_BUSY, 变更在真正提交后才投递
+    {
+        Sqlite3 reader;
+        reader.connect("/tmp/testChangeFeed");
+        Sqlite3Query query(reader, "SELECT k FROM kv;");
+        auto it = query.begin();
+
+        sqlite3.execute("BEGIN;");
+        sqlite3.execute("INSERT INTO kv (k, v) VALUES ('busy', '7');");
+        ret = sqlite3.execute("COMMIT;");
+        qInfo() << "commit while reading: " << ret << " (first row " << (*it).get<QString>(0) << ")";
+        query.finish();
+    }
+    ret = sqlite3.execute("COMMIT;");
+    qInfo() << "commit after reader: " << ret;
+
+    consumer.join();
+    sqlite3.unsubscribeChanges(feed);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <QDebug>
+#include <QFileInfo>
+
+using namespace sqlite3_wrap;
+
+static QString makeDocument(int id)
+{
+    QString doc = QString("{\"id\": %1, \"items\": [").arg(id);
+    for (int i = 0; i < 40; ++i) {
+        doc.append(QString("{\"name\": \"item-%1\", \"price\": %2, \"tags\": [\"a\", \"b\"]},").arg(i).arg(i * 3));
+    }
+    doc.append("{}]}");
+    return doc;
+}
+
+static qint64 fill(const QString& name, bool compressed)
+{
+    Sqlite3 db;
+    db.connect(name);
+    db.execute("DROP TABLE IF EXISTS docs;");
+    db.execute("CREATE TABLE docs (id INTEGER PRIMARY KEY, note TEXT, body);");
+    db.execute("VACUUM;");
+
+    Sqlite3Codec codec;
+    codec.threshold = 256;
+
+    db.execute("BEGIN;");
+    Sqlite3Command cmd(db, "INSERT INTO docs (id, note, body) VALUES (?, ?, ?);");
+    for (int id = 1; id <= 2000; ++id) {
+        cmd.reset();
+        cmd.bind(1, id);
+        cmd.bind(2, QString("short-%1").arg(id));
+        if (compressed) {
+            cmd.bindCompressed(3, makeDocument(id), codec);
+        }
+        else {
+            cmd.bind(3, makeDocument(id));
+        }
+        cmd.execute();
+    }
+    db.execute("COMMIT;");
+    db.execute("VACUUM;");
+    db.disconnect();
+
+    return QFileInfo(name + ".sqlite").size();
+}
+
+int main (int argc, char* argv[])
+{
+    const qint64 rawSize = fill("/tmp/testCompressRaw", false);
+    const qint64 packedSize = fill("/tmp/testCompress", true);
+    qInfo() << "file size raw: " << rawSize << ", compressed: " << packedSize;
+
+    Sqlite3 db;
+    db.connect("/tmp/testCompress");
+
+    int mismatches = 0;
+    Sqlite3Query query(db, "SELECT id, body, wrap_decompress(body) FROM docs;");
+    for (auto row : query) {
+        const int id = row.get<int>(0);
+        if (row.getDecompressed(1) != makeDocument(id) || row.get<QString>(2) != makeDocument(id)) {
+            ++mismatches;
+        }
+    }
+    qInfo() << "mismatches: " << mismatches;
+
+    // SQL 中直接查询压缩列
+    Sqlite3Query search(db, "SELECT count(*) FROM docs WHERE json_extract(wrap_decompress(body), '$.id') % 100 = 0;");
+    for (auto row : search) {
+        qInfo() << "json matches: " << row.get<int>(0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+int main (int argc, char* argv[])
+{
+    Sqlite3 db;
+
+    int ret = db.connect("/tmp/testCursor");
+    qInfo() << "ret: " << ret;
+
+    db.execute("DROP TABLE IF EXISTS events;");
+    db.execute("CREATE TABLE events (id INTEGER PRIMARY KEY, kind INTEGER NOT NULL, ts INTEGER NOT NULL);");
+    db.execute("CREATE INDEX events_ts ON events (ts, id);");
+    db.execute("BEGIN;");
+    for (int i = 1; i <= 1000; ++i) {
+        db.execute("INSERT INTO events (id, kind, ts) VALUES (%d, %d, %d);", i, i % 3, 100000 - i / 2);
+    }
+    db.execute("COMMIT;");
+
+    // ts 有重复, 以 id 作为第二个键保证唯一
+    QByteArray token;
+    {
+        Sqlite3Cursor cursor(db, "SELECT id, ts FROM events WHERE kind = ?", { "ts", "id" }, 100);
+        cursor.bindValue(1, 1);
+
+        Sqlite3Cursor::Page page;
+        for (int i = 0; i < 2 && cursor.fetch(page); ++i) {
+            qInfo() << "page " << i << ": " << page.rowCount() << " rows, first ts/id "
+                    << page.get<qint64>(0, 1) << "/" << page.get<qint64>(0, 0);
+        }
+        token = cursor.resumeToken();
+    }
+
+    // 在新的游标上从令牌处继续
+    Sqlite3Cursor cursor(db, "SELECT id, ts FROM events WHERE kind = ?", { "ts", "id" }, 100);
+    cursor.bindValue(1, 1);
+    if (!cursor.resume(token)) {
+        qWarning() << "bad token";
+        return 1;
+    }
+
+    int total = 0;
+    Sqlite3Cursor::Page page;
+    while (cursor.fetch(page)) {
+        total += page.rowCount();
+    }
+    qInfo() << "resumed rows: " << total;
+
+    return 0;
+}
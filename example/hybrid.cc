@@ -0,0 +1,91 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+static int countOnDisk(const char* dbName)
+{
+    Sqlite3 reader;
+    reader.connect(dbName);
+
+    int count = -1;
+    try {
+        Sqlite3Query query(reader, "SELECT count(*) FROM scratch;");
+        for (auto row : query) {
+            count = row.get<int>(0);
+        }
+    }
+    catch (std::exception& e) {
+        qWarning() << e.what();
+    }
+
+    return count;
+}
+
+int main (int argc, char* argv[])
+{
+    const char* dbName = "/tmp/testHybrid";
+    {
+        Sqlite3 db;
+        db.connect(dbName);
+        db.execute("DROP TABLE IF EXISTS scratch;");
+        db.execute("CREATE TABLE scratch (id INTEGER PRIMARY KEY, v INTEGER NOT NULL);");
+    }
+
+    Sqlite3HybridOptions options;
+    options.flushIntervalMs = 200;
+
+    Sqlite3 db;
+    int ret = db.connectHybrid(dbName, options);
+    qInfo() << "ret: " << ret;
+
+    // 每条写入都是独立的自动提交事务, 但只落在内存中
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= 20000; ++i) {
+        db.execute("INSERT INTO scratch (id, v) VALUES (%d, %d);", i, i * 7);
+    }
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    qInfo() << "20000 autocommit inserts: " << us / 1000 << " ms";
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    qInfo() << "on disk after periodic flush: " << countOnDisk(dbName);
+
+    db.execute("DELETE FROM scratch WHERE id > 10000;");
+    qInfo() << "flush: " << db.flush();
+    qInfo() << "on disk after flush(): " << countOnDisk(dbName);
+
+    // 写入持续进行时 flush() 也能在有限时间内完成
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; ++t) {
+        writers.emplace_back([&db, &stop, t] () {
+            for (int i = 0; !stop; ++i) {
+                db.execute("INSERT INTO scratch (id, v) VALUES (%d, %d);", 100000 + t * 1000000 + i, i);
+            }
+        });
+    }
+    for (int i = 0; i < 5; ++i) {
+        const auto flushStart = std::chrono::steady_clock::now();
+        ret = db.flush();
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - flushStart).count();
+        qInfo() << "flush while writing: " << ret << " in " << ms << " ms, on disk: " << countOnDisk(dbName);
+    }
+    stop = true;
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    db.execute("DELETE FROM scratch WHERE id > 5000;");
+    db.disconnect();
+    qInfo() << "on disk after disconnect(): " << countOnDisk(dbName);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+int main (int argc, char* argv[])
+{
+    {
+        Sqlite3 db;
+        db.connect("/tmp/testImmutable");
+        db.execute("DROP TABLE IF EXISTS words;");
+        db.execute("CREATE TABLE words (id INTEGER PRIMARY KEY, word TEXT NOT NULL);");
+        db.execute("BEGIN;");
+        for (int i = 1; i <= 10000; ++i) {
+            db.execute("INSERT INTO words (id, word) VALUES (%d, 'word-%d');", i, i);
+        }
+        db.execute("COMMIT;");
+    }
+
+    const Sqlite3ImmutableOptions::Preload modes[] = {
+        Sqlite3ImmutableOptions::PreloadNone,
+        Sqlite3ImmutableOptions::PreloadPageCache,
+        Sqlite3ImmutableOptions::PreloadMemory,
+    };
+    for (const auto mode : modes) {
+        Sqlite3ImmutableOptions options;
+        options.preload = mode;
+
+        // 每个线程一个只读连接, 查询之间没有任何锁
+        std::atomic<int> found(0);
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&found, &options, t] () {
+                Sqlite3 db;
+                if (SQLITE_OK != db.connectImmutable("/tmp/testImmutable", options)) {
+                    qWarning() << "connectImmutable failed: " << db.lastError();
+                    return;
+                }
+                Sqlite3Query query(db, "SELECT word FROM words WHERE id = ?;");
+                for (int id = t + 1; id <= 10000; id += 4) {
+                    query.reset();
+                    query.bind(1, id);
+                    if (SQLITE_ROW == query.step()) {
+                        ++found;
+                    }
+                }
+                if (SQLITE_READONLY != (db.execute("DELETE FROM words;") & 0xFF)) {
+                    qWarning() << "write was not rejected";
+                }
+            });
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+        qInfo() << "preload " << static_cast<int>(mode) << ": found " << found.load();
+    }
+
+    return 0;
+}
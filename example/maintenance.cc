@@ -0,0 +1,87 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <chrono>
+#include <thread>
+#include <QDebug>
+#include <QFileInfo>
+
+using namespace sqlite3_wrap;
+
+static int queryInt(Sqlite3& db, const char* sql)
+{
+    int value = -1;
+    try {
+        Sqlite3Query query(db, sql);
+        for (auto row : query) {
+            value = row.get<int>(0);
+        }
+    }
+    catch (std::exception& e) {
+        qWarning() << e.what();
+    }
+
+    return value;
+}
+
+static void printTask(const char* name, const Sqlite3MaintenanceTaskStatistics& task)
+{
+    qInfo() << "    " << name << " runs: " << task.runs << " interrupted: " << task.interrupted
+            << " total us: " << task.totalUs << " last rc: " << task.lastRc;
+}
+
+static void printState(Sqlite3& db, const char* dbName, const char* title)
+{
+    const Sqlite3MaintenanceStatistics stat = db.maintenanceStatistics();
+    qInfo() << title << " wal bytes: " << QFileInfo(QString(dbName) + "-wal").size()
+            << " freelist pages: " << queryInt(db, "PRAGMA freelist_count;");
+    printTask("checkpoint", stat.checkpoint);
+    printTask("vacuum", stat.vacuum);
+    printTask("optimize", stat.optimize);
+    qInfo() << "    checkpointed frames: " << stat.checkpointedFrames << " vacuumed pages: " << stat.vacuumedPages;
+}
+
+int main (int argc, char* argv[])
+{
+    const char* dbName = "/tmp/testMaintenance.sqlite";
+
+    Sqlite3 db;
+    int ret = db.connect(dbName);
+    qInfo() << "ret: " << ret;
+
+    // incremental_vacuum 需要 auto_vacuum = INCREMENTAL, 对已有的库要 VACUUM 一次才生效;
+    // 关闭自动 checkpoint, WAL 只由维护线程收缩
+    db.execute("PRAGMA journal_mode = WAL;");
+    db.execute("PRAGMA wal_autocheckpoint = 0;");
+    db.execute("DROP TABLE IF EXISTS blobs;");
+    db.execute("PRAGMA auto_vacuum = INCREMENTAL;");
+    db.execute("VACUUM;");
+    db.execute("PRAGMA wal_checkpoint(TRUNCATE);");
+    db.execute("CREATE TABLE blobs (id INTEGER PRIMARY KEY, payload BLOB NOT NULL);");
+
+    Sqlite3MaintenanceOptions options;
+    options.idleMs = 500;
+    options.intervalMs = 100;
+    options.walPassiveBytes = 256 << 10;
+    options.walTruncateBytes = 1 << 20;
+    ret = db.startMaintenance(options);
+    qInfo() << "startMaintenance: " << ret;
+
+    // 持续写入期间连接不空闲, 维护任务不会运行
+    const auto start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(1000)) {
+        db.execute("INSERT INTO blobs (payload) VALUES (randomblob(4000));");
+    }
+    db.execute("DELETE FROM blobs WHERE id % 4 != 0;");
+    printState(db, dbName, "after writes:");
+
+    // 超过空闲窗口后依次执行 checkpoint, incremental_vacuum 与 optimize
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.idleMs + 1500));
+    printState(db, dbName, "after idle:");
+
+    db.stopMaintenance();
+
+    return 0;
+}
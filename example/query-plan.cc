@@ -0,0 +1,74 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+static void printPlans(Sqlite3& db)
+{
+    for (const auto& plan : db.queryPlans()) {
+        qInfo() << plan.sql;
+        for (const auto& step : plan.steps) {
+            qInfo() << "    " << step;
+        }
+        qInfo() << "    hot: " << plan.hot << " full scans: " << plan.fullScans.size() << " temp b-tree: " << plan.tempBTree
+                << " fullscan steps: " << plan.fullScanSteps << " sorts: " << plan.sorts << " vm steps: " << plan.vmSteps;
+    }
+}
+
+int main (int argc, char* argv[])
+{
+    Sqlite3 db;
+
+    int ret = db.connect("/tmp/testQueryPlan");
+    qInfo() << "ret: " << ret;
+
+    db.execute("DROP TABLE IF EXISTS orders;");
+    db.execute("CREATE TABLE orders (id INTEGER PRIMARY KEY, customer INTEGER NOT NULL, total REAL NOT NULL, note TEXT);");
+    db.execute("CREATE INDEX orders_customer ON orders (customer);");
+    db.execute("BEGIN;");
+    for (int i = 1; i <= 2000; ++i) {
+        db.execute("INSERT INTO orders (id, customer, total, note) VALUES (%d, %d, %f, 'n-%d');", i, i % 50, i * 1.5, i);
+    }
+    db.execute("COMMIT;");
+
+    db.setPlanCheck(Sqlite3QueryPlan::Capture);
+
+    qInfo() << "note exists: " << db.checkKeyExist("orders", "note", "n-10");
+    qInfo() << "id exists: " << db.checkKeyExist("orders", "id", 10);
+
+    {
+        Sqlite3Query query(db, "SELECT id, total FROM orders WHERE customer = ? ORDER BY total;");
+        query.bind(1, 7);
+        for (auto row : query) {
+        }
+    }
+    printPlans(db);
+
+    // 热点语句上的全表扫描在 Strict 模式下直接失败
+    const char* hot = "SELECT id FROM orders WHERE note = ?;";
+    db.markHot(hot);
+    db.setPlanCheck(Sqlite3QueryPlan::Strict);
+    try {
+        Sqlite3Query query(db, hot);
+        qWarning() << "expected failure";
+    }
+    catch (std::exception& e) {
+        qInfo() << "strict: " << e.what();
+    }
+
+    // 关闭检查后不再残留上一次的失败原因
+    db.setPlanCheck(Sqlite3QueryPlan::Off);
+    qInfo() << "after off: " << db.lastError();
+    db.setPlanCheck(Sqlite3QueryPlan::Strict);
+
+    db.execute("CREATE INDEX orders_note ON orders (note);");
+    db.resetQueryPlans();
+    Sqlite3Query query(db, hot);
+    qInfo() << "strict with index: ok";
+
+    return 0;
+}
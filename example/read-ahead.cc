@@ -0,0 +1,69 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+
+#include <chrono>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+// 模拟较重的单行处理
+static quint64 process(const QString& payload)
+{
+    const QByteArray data = payload.toUtf8();
+    quint64 h = 0xcbf29ce484222325ULL;
+    for (int n = 0; n < 4; ++n) {
+        for (int i = 0; i < data.size(); ++i) {
+            h ^= static_cast<unsigned char>(data.at(i));
+            h *= 0x100000001b3ULL;
+        }
+    }
+    return h;
+}
+
+static qint64 elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main (int argc, char* argv[])
+{
+    Sqlite3 db;
+
+    int ret = db.connect("/tmp/testReadAhead");
+    qInfo() << "ret: " << ret;
+
+    db.execute("DROP TABLE IF EXISTS docs;");
+    db.execute("CREATE TABLE docs (id INTEGER PRIMARY KEY, payload TEXT NOT NULL);");
+    db.execute("BEGIN;");
+    for (int i = 1; i <= 50000; ++i) {
+        db.execute("INSERT INTO docs (id, payload) VALUES (%d, printf('%%.*c', 200 + %d %% 300, 'x'));", i, i);
+    }
+    db.execute("COMMIT;");
+
+    Sqlite3Query query(db, "SELECT id, payload FROM docs WHERE length(payload) > 0;");
+
+    auto start = std::chrono::steady_clock::now();
+    int rows = 0;
+    quint64 sum = 0;
+    for (auto row : query) {
+        sum += process(row.get<QString>(1));
+        ++rows;
+    }
+    query.reset();
+    qInfo() << "inline    : " << rows << " rows, " << elapsedMs(start) << " ms";
+
+    start = std::chrono::steady_clock::now();
+    rows = 0;
+    {
+        Sqlite3ReadAhead readAhead(query, 256, 4);
+        for (const auto& row : readAhead) {
+            sum -= process(row.get<QString>(1));
+            ++rows;
+        }
+    }
+    qInfo() << "read-ahead: " << rows << " rows, " << elapsedMs(start) << " ms, checksum " << (0 == sum ? "ok" : "mismatch");
+
+    return 0;
+}
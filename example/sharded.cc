@@ -0,0 +1,82 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-sharded.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+int main (int argc, char* argv[])
+{
+    ShardedSqlite3 sharded(4);
+
+    int ret = sharded.connect("/tmp/testSharded");
+    qInfo() << "ret: " << ret;
+
+    sharded.executeAll("DROP TABLE IF EXISTS users;");
+    sharded.executeAll("CREATE TABLE users (id INTEGER PRIMARY KEY, name TEXT NOT NULL);");
+
+    // 不同分片的写入互不阻塞
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&sharded, t] () {
+            for (qint64 id = t * 100 + 1; id <= t * 100 + 100; ++id) {
+                sharded.execute(id, "INSERT INTO users (id, name) VALUES (?, ?);", QVariantList { id, QString("user-%1").arg(id) });
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    try {
+        for (const auto& row : sharded.select(static_cast<qint64>(42), "SELECT id, name FROM users WHERE id = ?;", QVariantList { 42 })) {
+            qInfo() << "shard " << sharded.shardOf(static_cast<qint64>(42)) << ": " << row.at(0).toLongLong() << "\t" << row.at(1).toString();
+        }
+
+        const auto rows = sharded.scan("SELECT id, name FROM users WHERE id > ? ORDER BY id;", QVariantList { 390 }, 0);
+        for (const auto& row : rows) {
+            qInfo() << row.at(0).toLongLong() << "\t" << row.at(1).toString();
+        }
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    // 短查询的 scatter-gather 复用各分片的常驻线程, 不再每次创建线程
+    try {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 1000; ++i) {
+            sharded.scan("SELECT id FROM users WHERE id = ?;", QVariantList { i });
+        }
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        qInfo() << "1000 point scans: " << us / 1000 << " ms";
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    // 合并顺序与 SQLite 一致: NULL < 数值 < TEXT (UTF-8 字节) < BLOB
+    sharded.executeAll("DROP TABLE IF EXISTS mixed;");
+    sharded.executeAll("CREATE TABLE mixed (id INTEGER PRIMARY KEY, v);");
+    const QVariantList values {
+        QVariant(), 7, 2.5, QString::fromUtf8("\xF0\x9F\x98\x80"), QString::fromUtf8("\xEE\x80\x80"), QString("abc"), QByteArray("\x01\x02", 2), -3
+    };
+    for (int i = 0; i < values.size(); ++i) {
+        sharded.execute(static_cast<qint64>(i), "INSERT INTO mixed (id, v) VALUES (?, ?);", QVariantList { i, values.at(i) });
+    }
+    try {
+        for (const auto& row : sharded.scan("SELECT id, v FROM mixed ORDER BY v;", QVariantList(), 1)) {
+            qInfo() << "mixed: " << row.at(0).toLongLong() << "\t" << row.at(1);
+        }
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    return 0;
+}
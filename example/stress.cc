@@ -0,0 +1,355 @@
+//
+// Created by dingjing on 10/18/26.
+//
+// 多进程 × 多线程 读写压力测试, 用于复现/验证锁竞争 (SQLITE_BUSY、lockForWrite() 等待)
+//
+// 用法: stress.run [--db PATH] [--processes P] [--threads T] [--seconds S]
+//                  [--write-ratio R] [--rows N] [--busy-timeout MS] [--wal] [--shared]
+//
+#include "sqlite3-wrap.h"
+
+#include <thread>
+#include <memory>
+#include <random>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+struct Options
+{
+    QString         db = "/tmp/sqlite3-stress";
+    int             processes = 2;
+    int             threads = 4;
+    int             seconds = 5;
+    double          writeRatio = 0.2;
+    int             rows = 10000;
+    int             busyTimeout = 0;
+    bool            wal = false;
+    bool            shared = false;             // 进程内所有线程共用一个 Sqlite3
+};
+
+// 子进程通过管道回传给父进程的汇总, 随后是 latencies 个 quint64 纳秒延迟
+struct Report
+{
+    quint64         reads = 0;
+    quint64         writes = 0;
+    quint64         busy = 0;
+    quint64         locked = 0;
+    quint64         errors = 0;
+    quint64         lockAcquisitions = 0;
+    quint64         lockWaitNs = 0;
+    quint64         lockMaxWaitNs = 0;
+    quint64         latencies = 0;
+};
+
+static void usage(const char* prog)
+{
+    ::fprintf(stderr, "usage: %s [--db PATH] [--processes P] [--threads T] [--seconds S] "
+                      "[--write-ratio R] [--rows N] [--busy-timeout MS] [--wal] [--shared]\n", prog);
+}
+
+static bool parseOptions(int argc, char* argv[], Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        const QString arg = argv[i];
+        const bool hasValue = (i + 1 < argc);
+        if ("--wal" == arg) {
+            opt.wal = true;
+        }
+        else if ("--shared" == arg) {
+            opt.shared = true;
+        }
+        else if ("--db" == arg && hasValue) {
+            opt.db = argv[++i];
+        }
+        else if ("--processes" == arg && hasValue) {
+            opt.processes = std::max(1, ::atoi(argv[++i]));
+        }
+        else if ("--threads" == arg && hasValue) {
+            opt.threads = std::max(1, ::atoi(argv[++i]));
+        }
+        else if ("--seconds" == arg && hasValue) {
+            opt.seconds = std::max(1, ::atoi(argv[++i]));
+        }
+        else if ("--write-ratio" == arg && hasValue) {
+            opt.writeRatio = std::min(1.0, std::max(0.0, ::atof(argv[++i])));
+        }
+        else if ("--rows" == arg && hasValue) {
+            opt.rows = std::max(1, ::atoi(argv[++i]));
+        }
+        else if ("--busy-timeout" == arg && hasValue) {
+            opt.busyTimeout = std::max(0, ::atoi(argv[++i]));
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int connect(Sqlite3& db, const Options& opt)
+{
+    int rc = db.connect(opt.db);
+    if (SQLITE_OK == rc && opt.busyTimeout > 0) {
+        rc = db.execute("PRAGMA busy_timeout = %d;", opt.busyTimeout);
+    }
+    return rc;
+}
+
+static bool prepareDatabase(const Options& opt)
+{
+    Sqlite3 db;
+    if (SQLITE_OK != connect(db, opt)) {
+        qCritical() << "connect failed: " << db.lastError();
+        return false;
+    }
+    if (opt.wal) {
+        db.execute("PRAGMA journal_mode = WAL;");
+    }
+    db.execute("DROP TABLE IF EXISTS stress;");
+    db.execute("CREATE TABLE stress (id INTEGER PRIMARY KEY, v INTEGER NOT NULL, payload TEXT);");
+    db.execute("BEGIN;");
+    for (int i = 1; i <= opt.rows; ++i) {
+        db.execute("INSERT INTO stress (id, v, payload) VALUES (%d, 0, 'init');", i);
+    }
+    const int rc = db.execute("COMMIT;");
+    if (SQLITE_OK != rc) {
+        qCritical() << "prepare failed: " << db.lastError();
+        return false;
+    }
+    db.disconnect();
+
+    return true;
+}
+
+static void countResult(int rc, Report& report)
+{
+    switch (rc & 0xFF) {
+        case SQLITE_OK:
+        case SQLITE_ROW:
+        case SQLITE_DONE: {
+            break;
+        }
+        case SQLITE_BUSY: {
+            ++report.busy;
+            break;
+        }
+        case SQLITE_LOCKED: {
+            ++report.locked;
+            break;
+        }
+        default: {
+            ++report.errors;
+            break;
+        }
+    }
+}
+
+static void worker(Sqlite3& db, const Options& opt, int seed, Report& report, std::vector<quint64>& latencies)
+{
+    std::mt19937 rng(static_cast<unsigned>(seed));
+    std::uniform_int_distribution<int> key(1, opt.rows);
+    std::uniform_real_distribution<double> mix(0.0, 1.0);
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(opt.seconds);
+    try {
+        Sqlite3Query query(db, "SELECT v, payload FROM stress WHERE id = ?;");
+        while (std::chrono::steady_clock::now() < deadline) {
+            const int id = key(rng);
+            const auto start = std::chrono::steady_clock::now();
+            int rc = SQLITE_OK;
+            if (mix(rng) < opt.writeRatio) {
+                rc = db.execute("UPDATE stress SET v = v + 1, payload = 'w-%d' WHERE id = %d;", seed, id);
+                ++report.writes;
+            }
+            else {
+                query.reset();
+                query.bind(1, id);
+                while (SQLITE_ROW == (rc = query.step())) {
+                }
+                ++report.reads;
+            }
+            latencies.push_back(static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+            countResult(rc, report);
+        }
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+        ++report.errors;
+    }
+}
+
+static bool writeAll(int fd, const void* data, size_t size)
+{
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::write(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool readAll(int fd, void* data, size_t size)
+{
+    auto p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = ::read(fd, p, size);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static void runProcess(const Options& opt, int index, int fd)
+{
+    std::vector<std::unique_ptr<Sqlite3>> dbs(opt.shared ? 1 : opt.threads);
+    for (auto& db : dbs) {
+        db.reset(new Sqlite3);
+        if (SQLITE_OK != connect(*db, opt)) {
+            qCritical() << "connect failed: " << db->lastError();
+            ::_exit(1);
+        }
+    }
+
+    std::vector<Report> reports(opt.threads);
+    std::vector<std::vector<quint64>> latencies(opt.threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < opt.threads; ++t) {
+        Sqlite3& db = *dbs[opt.shared ? 0 : t];
+        threads.emplace_back(worker, std::ref(db), std::cref(opt), index * 1000 + t, std::ref(reports[t]), std::ref(latencies[t]));
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    Report total;
+    std::vector<quint64> merged;
+    for (int t = 0; t < opt.threads; ++t) {
+        total.reads += reports[t].reads;
+        total.writes += reports[t].writes;
+        total.busy += reports[t].busy;
+        total.locked += reports[t].locked;
+        total.errors += reports[t].errors;
+        merged.insert(merged.end(), latencies[t].begin(), latencies[t].end());
+    }
+    for (auto& db : dbs) {
+        const auto stat = db->lockStatistics();
+        total.lockAcquisitions += stat.acquisitions;
+        total.lockWaitNs += stat.waitNs;
+        total.lockMaxWaitNs = std::max(total.lockMaxWaitNs, stat.maxWaitNs);
+        db->disconnect();
+    }
+    total.latencies = merged.size();
+
+    const bool ok = writeAll(fd, &total, sizeof(total))
+                 && writeAll(fd, merged.data(), merged.size() * sizeof(quint64));
+    ::close(fd);
+    ::_exit(ok ? 0 : 1);
+}
+
+static double percentileMs(const std::vector<quint64>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto idx = std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())));
+    return static_cast<double>(sorted[idx]) / 1e6;
+}
+
+int main (int argc, char* argv[])
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 连接不能跨 fork, 父进程建表后立即断开
+    if (!prepareDatabase(opt)) {
+        return 1;
+    }
+
+    std::vector<int> fds;
+    std::vector<pid_t> pids;
+    for (int i = 0; i < opt.processes; ++i) {
+        int pipefd[2];
+        if (0 != ::pipe(pipefd)) {
+            ::perror("pipe");
+            return 1;
+        }
+        const pid_t pid = ::fork();
+        if (pid < 0) {
+            ::perror("fork");
+            return 1;
+        }
+        if (0 == pid) {
+            ::close(pipefd[0]);
+            runProcess(opt, i, pipefd[1]);
+        }
+        ::close(pipefd[1]);
+        fds.push_back(pipefd[0]);
+        pids.push_back(pid);
+    }
+
+    Report total;
+    std::vector<quint64> latencies;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        Report report;
+        if (readAll(fds[i], &report, sizeof(report))) {
+            std::vector<quint64> part(report.latencies);
+            if (readAll(fds[i], part.data(), part.size() * sizeof(quint64))) {
+                latencies.insert(latencies.end(), part.begin(), part.end());
+            }
+            total.reads += report.reads;
+            total.writes += report.writes;
+            total.busy += report.busy;
+            total.locked += report.locked;
+            total.errors += report.errors;
+            total.lockAcquisitions += report.lockAcquisitions;
+            total.lockWaitNs += report.lockWaitNs;
+            total.lockMaxWaitNs = std::max(total.lockMaxWaitNs, report.lockMaxWaitNs);
+        }
+        else {
+            qCritical() << "process " << i << " returned no report";
+        }
+        ::close(fds[i]);
+    }
+    for (const pid_t pid : pids) {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    const double ops = static_cast<double>(total.reads + total.writes);
+
+    ::printf("processes=%d threads=%d seconds=%d write-ratio=%.2f rows=%d busy-timeout=%d wal=%d shared=%d\n",
+             opt.processes, opt.threads, opt.seconds, opt.writeRatio, opt.rows, opt.busyTimeout, opt.wal, opt.shared);
+    ::printf("ops          : %.0f (reads %llu, writes %llu)\n", ops, total.reads, total.writes);
+    ::printf("throughput   : %.1f ops/s\n", ops / opt.seconds);
+    ::printf("latency ms   : p50 %.3f  p99 %.3f  p999 %.3f  max %.3f\n",
+             percentileMs(latencies, 0.50), percentileMs(latencies, 0.99), percentileMs(latencies, 0.999),
+             latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / 1e6);
+    ::printf("errors       : busy %llu  locked %llu  other %llu\n", total.busy, total.locked, total.errors);
+    ::printf("lockForWrite : %llu acquisitions, wait total %.3f ms, avg %.3f ms, max %.3f ms\n",
+             total.lockAcquisitions, static_cast<double>(total.lockWaitNs) / 1e6,
+             total.lockAcquisitions ? static_cast<double>(total.lockWaitNs) / 1e6 / static_cast<double>(total.lockAcquisitions) : 0.0,
+             static_cast<double>(total.lockMaxWaitNs) / 1e6);
+
+    return 0;
+}
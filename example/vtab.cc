@@ -0,0 +1,107 @@
+//
+// Created by dingjing on 10/18/26.
+//
+#include "sqlite3-wrap.h"
+#include "sqlite3-vtab.h"
+
+#include <vector>
+#include <QDebug>
+
+using namespace sqlite3_wrap;
+
+struct Item
+{
+    qint64      id;
+    QString     name;
+    double      price;
+};
+
+int main (int argc, char* argv[])
+{
+    Sqlite3 sqlite3;
+
+    int ret = sqlite3.connect("/tmp/testVTab");
+    qInfo() << "ret: " << ret << " msg: " << sqlite3.lastError();
+
+    sqlite3.execute("CREATE TABLE IF NOT EXISTS orders (id INTEGER PRIMARY KEY, item_id INTEGER, amount INTEGER);");
+    sqlite3.execute("DELETE FROM orders;");
+    sqlite3.execute("INSERT INTO orders (item_id, amount) VALUES (2, 10), (4, 1), (7, 3);");
+
+    // 按 id 升序
+    std::vector<Item> items;
+    for (qint64 i = 1; i <= 8; ++i) {
+        items.push_back(Item { i, QString("item-%1").arg(i), i * 1.5 });
+    }
+
+    Sqlite3VTable<std::vector<Item>> vt(items);
+    vt.key("id", &Item::id).column("name", &Item::name).column("price", &Item::price);
+    ret = vt.registerTo(sqlite3, "mem_items");
+    qInfo() << "register: " << ret << " msg: " << sqlite3.lastError();
+
+    try {
+        sqlite3_wrap::Sqlite3Query query(sqlite3, "SELECT o.id, m.name, m.price * o.amount FROM orders o JOIN mem_items m ON m.id = o.item_id;");
+        for (auto row : query) {
+            qInfo() << row.get<int>(0) << "\t" << row.get<QString>(1) << "\t" << row.get<double>(2);
+        }
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    try {
+        sqlite3_wrap::Sqlite3Query query(sqlite3, "SELECT id, name FROM mem_items WHERE id > ? AND id <= ? ORDER BY id;");
+        query.bind(1, 3);
+        query.bind(2, 6);
+        for (auto row : query) {
+            qInfo() << row.get<int>(0) << "\t" << row.get<QString>(1);
+        }
+    }
+    catch (std::exception &e) {
+        qCritical() << "exception: " << e.what();
+    }
+
+    // 非 BINARY 排序规则的约束不做二分查找, 由 SQLite 逐行判断
+    {
+        std::vector<Item> named;
+        named.push_back(Item { 1, "ABC", 1.0 });
+        named.push_back(Item { 2, "abc", 2.0 });
+        named.push_back(Item { 3, "xyz", 3.0 });
+        Sqlite3VTable<std::vector<Item>> byName(named);
+        byName.key("name", &Item::name).column("id", &Item::id);
+        byName.registerTo(sqlite3, "mem_names");
+
+        sqlite3_wrap::Sqlite3Query query(sqlite3, "SELECT count(*) FROM mem_names WHERE name = 'abc' COLLATE NOCASE;");
+        for (auto row : query) {
+            qInfo() << "nocase matches: " << row.get<int>(0);
+        }
+    }
+
+    // 文本 key 按 UTF-8 字节排序: U+E000 在 UTF-8 中排在增补平面字符之前, UTF-16 中则相反
+    {
+        std::vector<Item> named;
+        named.push_back(Item { 1, QString::fromUtf8("\xEE\x80\x80"), 1.0 });
+        named.push_back(Item { 2, QString::fromUtf8("\xF0\x9F\x98\x80"), 2.0 });
+        Sqlite3VTable<std::vector<Item>> byName(named);
+        byName.key("name", &Item::name).column("id", &Item::id);
+        byName.registerTo(sqlite3, "mem_emoji");
+
+        sqlite3_wrap::Sqlite3Query query(sqlite3, "SELECT id FROM mem_emoji WHERE name = ?;");
+        query.bind(1, QString::fromUtf8("\xF0\x9F\x98\x80"));
+        for (auto row : query) {
+            qInfo() << "supplementary match id: " << row.get<int>(0);
+        }
+    }
+
+    // 对象已析构: 查询返回错误而不是访问已释放的内存
+    try {
+        sqlite3_wrap::Sqlite3Query query(sqlite3, "SELECT count(*) FROM mem_names;");
+        for (auto row : query) {
+            qWarning() << "unexpected: " << row.get<int>(0);
+        }
+    }
+    catch (std::exception &e) {
+        qInfo() << "after destroy: " << e.what();
+    }
+
+    return 0;
+}
@@ -0,0 +1,382 @@
+//
+// Created by dingjing on 10/18/26.
+//
+
+#include "sqlite3-sharded.h"
+
+#include <deque>
+#include <thread>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+
+#include <QDebug>
+#include <QMutex>
+#include <QWaitCondition>
+
+
+namespace sqlite3_wrap
+{
+    // splitmix64 finalizer
+    static quint64 mixKey(quint64 x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+
+        return x;
+    }
+
+    // FNV-1a 64
+    static quint64 hashKey(const QByteArray& key)
+    {
+        quint64 h = 0xcbf29ce484222325ULL;
+        for (int i = 0; i < key.size(); ++i) {
+            h ^= static_cast<unsigned char>(key.at(i));
+            h *= 0x100000001b3ULL;
+        }
+
+        return h;
+    }
+
+    // SQLite 的存储类别: NULL < INTEGER/REAL < TEXT < BLOB
+    static int storageClass(const QVariant& v)
+    {
+        switch (v.type()) {
+            case QVariant::Invalid: {
+                return 0;
+            }
+            case QVariant::Bool:
+            case QVariant::Int:
+            case QVariant::UInt:
+            case QVariant::LongLong:
+            case QVariant::ULongLong:
+            case QVariant::Double: {
+                return 1;
+            }
+            case QVariant::ByteArray: {
+                return 3;
+            }
+            default: {
+                return 2;
+            }
+        }
+    }
+
+    static int compareBytes(const QByteArray& a, const QByteArray& b)
+    {
+        const int c = ::memcmp(a.constData(), b.constData(), static_cast<size_t>(qMin(a.size(), b.size())));
+        if (0 != c) {
+            return (c < 0) ? -1 : 1;
+        }
+
+        return (a.size() < b.size()) ? -1 : ((a.size() > b.size()) ? 1 : 0);
+    }
+
+    // 与 SQLite 的 ORDER BY (BINARY) 一致: 先按存储类别, 数值按大小, TEXT 按 UTF-8 字节, BLOB 按 memcmp
+    static int compareValue(const QVariant& a, const QVariant& b)
+    {
+        const int classA = storageClass(a);
+        const int classB = storageClass(b);
+        if (classA != classB) {
+            return (classA < classB) ? -1 : 1;
+        }
+
+        switch (classA) {
+            case 0: {
+                return 0;
+            }
+            case 1: {
+                if (QVariant::Double != a.type() && QVariant::Double != b.type()) {
+                    const qint64 x = a.toLongLong();
+                    const qint64 y = b.toLongLong();
+                    return (x < y) ? -1 : ((x > y) ? 1 : 0);
+                }
+                const double x = a.toDouble();
+                const double y = b.toDouble();
+                return (x < y) ? -1 : ((x > y) ? 1 : 0);
+            }
+            case 3: {
+                return compareBytes(a.toByteArray(), b.toByteArray());
+            }
+            default: {
+                return compareBytes(a.toString().toUtf8(), b.toString().toUtf8());
+            }
+        }
+    }
+}
+
+
+struct sqlite3_wrap::ShardedSqlite3::Worker
+{
+    std::thread                             thread;
+    QMutex                                  locker;         // 保护 tasks 与 stop
+    QWaitCondition                          condition;
+    std::deque<std::function<void()>>       tasks;
+    bool                                    stop = false;
+};
+
+sqlite3_wrap::ShardedSqlite3::ShardedSqlite3(int shardCount, bool showSQL)
+    : mShowSQL(showSQL)
+{
+    const int count = qMax(shardCount, 1);
+    for (int i = 0; i < count; ++i) {
+        mShards.emplace_back(new Sqlite3(mShowSQL));
+    }
+    for (int i = 0; i + 1 < count; ++i) {
+        mWorkers.emplace_back(new Worker);
+        mWorkers.back()->thread = std::thread(&ShardedSqlite3::workerLoop, mWorkers.back().get());
+    }
+}
+
+sqlite3_wrap::ShardedSqlite3::~ShardedSqlite3()
+{
+    for (auto& worker : mWorkers) {
+        QMutexLocker locker(&worker->locker);
+        worker->stop = true;
+        worker->condition.wakeAll();
+    }
+    for (auto& worker : mWorkers) {
+        worker->thread.join();
+    }
+    disconnect();
+}
+
+int sqlite3_wrap::ShardedSqlite3::connect(const QString & dbName)
+{
+    QString base = dbName;
+    if (base.endsWith(".sqlite")) {
+        base.chop(7);
+    }
+
+    int ret = SQLITE_OK;
+    for (size_t i = 0; i < mShards.size(); ++i) {
+        const int rc = mShards[i]->connect(QString("%1-%2").arg(base).arg(static_cast<int>(i)));
+        if (SQLITE_OK != rc) {
+            qWarning() << "ShardedSqlite3::connect --> shard " << static_cast<int>(i) << " failed: " << mShards[i]->lastError();
+            if (SQLITE_OK == ret) {
+                ret = rc;
+            }
+        }
+    }
+
+    return ret;
+}
+
+void sqlite3_wrap::ShardedSqlite3::disconnect()
+{
+    for (auto& shard : mShards) {
+        shard->disconnect();
+    }
+}
+
+int sqlite3_wrap::ShardedSqlite3::shardCount() const
+{
+    return static_cast<int>(mShards.size());
+}
+
+int sqlite3_wrap::ShardedSqlite3::shardOf(qint64 key) const
+{
+    return static_cast<int>(mixKey(static_cast<quint64>(key)) % mShards.size());
+}
+
+int sqlite3_wrap::ShardedSqlite3::shardOf(const QString & key) const
+{
+    return static_cast<int>(hashKey(key.toUtf8()) % mShards.size());
+}
+
+sqlite3_wrap::Sqlite3 & sqlite3_wrap::ShardedSqlite3::shard(int idx)
+{
+    return *mShards.at(static_cast<size_t>(idx));
+}
+
+int sqlite3_wrap::ShardedSqlite3::executeAll(const QString & sql)
+{
+    int ret = SQLITE_OK;
+    for (auto& shard : mShards) {
+        const int rc = shard->execute("%s", sql.toUtf8().constData());
+        if (SQLITE_OK != rc && SQLITE_OK == ret) {
+            ret = rc;
+        }
+    }
+
+    return ret;
+}
+
+int sqlite3_wrap::ShardedSqlite3::execute(qint64 key, const QString & sql, const QVariantList & binds)
+{
+    return executeOn(shardOf(key), sql, binds);
+}
+
+int sqlite3_wrap::ShardedSqlite3::execute(const QString & key, const QString & sql, const QVariantList & binds)
+{
+    return executeOn(shardOf(key), sql, binds);
+}
+
+QList<sqlite3_wrap::ShardedSqlite3::Row> sqlite3_wrap::ShardedSqlite3::select(qint64 key, const QString & sql, const QVariantList & binds)
+{
+    return selectOn(shardOf(key), sql, binds);
+}
+
+QList<sqlite3_wrap::ShardedSqlite3::Row> sqlite3_wrap::ShardedSqlite3::select(const QString & key, const QString & sql, const QVariantList & binds)
+{
+    return selectOn(shardOf(key), sql, binds);
+}
+
+QList<sqlite3_wrap::ShardedSqlite3::Row> sqlite3_wrap::ShardedSqlite3::scan(const QString & sql, const QVariantList & binds, int orderColumn, bool descending, int limit)
+{
+    const size_t count = mShards.size();
+    std::vector<QList<Row>> parts(count);
+    std::vector<std::exception_ptr> errors(count);
+    const auto run = [&] (size_t i) {
+        try {
+            parts[i] = selectOn(static_cast<int>(i), sql, binds);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    // 并发的 scan() 在同一个工作线程上排队, 各自只等待自己的任务;
+    // 完成计数由任务共同持有, 工作线程唤醒调用者之后仍可安全解锁
+    struct Done
+    {
+        QMutex              locker;
+        QWaitCondition      condition;
+        size_t              remaining = 0;
+    };
+    const auto done = std::make_shared<Done>();
+    done->remaining = mWorkers.size();
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        Worker* worker = mWorkers[i].get();
+        QMutexLocker locker(&worker->locker);
+        worker->tasks.push_back([&run, done, i] () {
+            run(i);
+            QMutexLocker doneLocker(&done->locker);
+            if (0 == --done->remaining) {
+                done->condition.wakeAll();
+            }
+        });
+        worker->condition.wakeAll();
+    }
+    run(count - 1);
+    {
+        QMutexLocker doneLocker(&done->locker);
+        while (done->remaining > 0) {
+            done->condition.wait(&done->locker);
+        }
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    QList<Row> rows;
+    const auto full = [&] () { return limit >= 0 && rows.size() >= limit; };
+    if (orderColumn < 0) {
+        for (auto& part : parts) {
+            for (auto& row : part) {
+                if (full()) {
+                    return rows;
+                }
+                rows.append(row);
+            }
+        }
+        return rows;
+    }
+
+    // 分片数量很小, 每次线性挑选各分片当前行中的最小 (或最大) 者
+    std::vector<int> heads(count, 0);
+    while (!full()) {
+        int best = -1;
+        for (size_t i = 0; i < count; ++i) {
+            if (heads[i] >= parts[i].size()) {
+                continue;
+            }
+            if (best < 0) {
+                best = static_cast<int>(i);
+                continue;
+            }
+            const int cmp = compareValue(parts[i].at(heads[i]).value(orderColumn), parts[best].at(heads[best]).value(orderColumn));
+            if (descending ? (cmp > 0) : (cmp < 0)) {
+                best = static_cast<int>(i);
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        rows.append(parts[best].at(heads[best]++));
+    }
+
+    return rows;
+}
+
+void sqlite3_wrap::ShardedSqlite3::workerLoop(Worker * worker)
+{
+    QMutexLocker locker(&worker->locker);
+    while (true) {
+        while (!worker->stop && worker->tasks.empty()) {
+            worker->condition.wait(&worker->locker);
+        }
+        if (worker->tasks.empty()) {
+            break;
+        }
+        const std::function<void()> task = std::move(worker->tasks.front());
+        worker->tasks.pop_front();
+        locker.unlock();
+        task();
+        locker.relock();
+    }
+}
+
+int sqlite3_wrap::ShardedSqlite3::executeOn(int idx, const QString & sql, const QVariantList & binds)
+{
+    Sqlite3& db = shard(idx);
+    try {
+        Sqlite3WriteLocker locker(db);
+        Sqlite3Command cmd(db);
+        int rc = cmd.prepare(sql);
+        if (SQLITE_OK != rc) {
+            return rc;
+        }
+        for (int i = 0; i < binds.size(); ++i) {
+            if (SQLITE_OK != (rc = cmd.bindValue(i + 1, binds.at(i)))) {
+                return rc;
+            }
+        }
+        return cmd.execute();
+    }
+    catch (std::exception &e) {
+        qWarning() << "ShardedSqlite3::execute --> " << e.what();
+    }
+
+    return SQLITE_ERROR;
+}
+
+QList<sqlite3_wrap::ShardedSqlite3::Row> sqlite3_wrap::ShardedSqlite3::selectOn(int idx, const QString & sql, const QVariantList & binds)
+{
+    Sqlite3& db = shard(idx);
+    Sqlite3Query query(db, sql);
+    for (int i = 0; i < binds.size(); ++i) {
+        if (SQLITE_OK != query.bindValue(i + 1, binds.at(i))) {
+            throw std::runtime_error(db.lastError().toStdString());
+        }
+    }
+
+    QList<Row> rows;
+    const int columns = query.columnCount();
+    for (auto row : query) {
+        Row values;
+        values.reserve(columns);
+        for (int i = 0; i < columns; ++i) {
+            values.append(row.get<QVariant>(i));
+        }
+        rows.append(values);
+    }
+
+    return rows;
+}
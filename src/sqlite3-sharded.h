@@ -0,0 +1,86 @@
+//
+// Created by dingjing on 10/18/26.
+//
+
+#ifndef sqlite3_wrap_SQLITE_3_SHARDED_H
+#define sqlite3_wrap_SQLITE_3_SHARDED_H
+#include "sqlite3-wrap.h"
+
+#include <vector>
+#include <memory>
+
+#include <QList>
+#include <QVariant>
+
+namespace sqlite3_wrap
+{
+    /**
+     * @brief 按 key 的哈希把一张表水平拆分到 N 个数据库文件, 每个分片拥有独立的连接与写锁
+     *
+     * 分片文件名为 <dbName>-<i>.sqlite; 点操作路由到单个分片, scan() 在所有分片上并行执行再合并结果。
+     *
+     * @note 路由哈希不依赖 Qt 的 qHash, 跨版本/进程稳定; 分片数量确定后不能更改
+     */
+    class ShardedSqlite3
+    {
+    public:
+        using Row = QVariantList;
+
+        explicit ShardedSqlite3(int shardCount, bool showSQL = false);
+        ~ShardedSqlite3();
+        ShardedSqlite3(const ShardedSqlite3&) = delete;
+        ShardedSqlite3& operator=(const ShardedSqlite3&) = delete;
+
+        /**
+         * @return 第一个失败分片的错误码, 全部成功返回 SQLITE_OK
+         */
+        int connect(const QString& dbName);
+        void disconnect();
+
+        int shardCount() const;
+        int shardOf(qint64 key) const;
+        int shardOf(const QString& key) const;
+        Sqlite3& shard(int idx);
+
+        /**
+         * @brief 在每个分片上执行 (建表、建索引等)
+         */
+        int executeAll(const QString& sql);
+
+        /**
+         * @brief 路由到 key 所在分片执行写入, 持有该分片的写锁
+         * @param binds 按位置绑定, 从 ?1 开始
+         */
+        int execute(qint64 key, const QString& sql, const QVariantList& binds = QVariantList());
+        int execute(const QString& key, const QString& sql, const QVariantList& binds = QVariantList());
+
+        /**
+         * @brief 路由到 key 所在分片查询
+         * @throw std::runtime_error 失败时
+         */
+        QList<Row> select(qint64 key, const QString& sql, const QVariantList& binds = QVariantList());
+        QList<Row> select(const QString& key, const QString& sql, const QVariantList& binds = QVariantList());
+
+        /**
+         * @brief 在所有分片上并行执行查询并合并; 最后一个分片在调用线程上执行, 其余交给各分片常驻的工作线程
+         * @param orderColumn >= 0 时各分片结果须已按该列排序 (ORDER BY), 合并后保持全局有序; 否则按分片顺序拼接
+         * @param limit 合并后最多返回的行数, < 0 不限制
+         * @throw std::runtime_error 任一分片失败时
+         */
+        QList<Row> scan(const QString& sql, const QVariantList& binds = QVariantList(), int orderColumn = -1, bool descending = false, int limit = -1);
+
+    private:
+        struct Worker;
+
+        int executeOn(int idx, const QString& sql, const QVariantList& binds);
+        QList<Row> selectOn(int idx, const QString& sql, const QVariantList& binds);
+        static void workerLoop(Worker* worker);
+
+    private:
+        bool                                        mShowSQL;
+        std::vector<std::unique_ptr<Sqlite3>>       mShards;
+        std::vector<std::unique_ptr<Worker>>        mWorkers;       // 分片 0 .. N-2 各一个, 随对象创建与销毁
+    };
+}
+
+#endif // sqlite3_wrap_SQLITE_3_SHARDED_H
@@ -0,0 +1,502 @@
+//
+// Created by dingjing on 10/18/26.
+//
+
+#ifndef sqlite3_wrap_SQLITE_3_VTAB_H
+#define sqlite3_wrap_SQLITE_3_VTAB_H
+#include "sqlite3-wrap.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <QByteArray>
+
+namespace sqlite3_wrap
+{
+    namespace vtab
+    {
+        template<class T, class = void>
+        struct ColumnTraits;
+
+        template<class T>
+        struct ColumnTraits<T, typename std::enable_if<std::is_integral<T>::value>::type>
+        {
+            static const char* declType() { return "INTEGER"; }
+            static void result(sqlite3_context* ctx, const T& value)
+            {
+                sqlite3_result_int64(ctx, static_cast<sqlite3_int64>(value));
+            }
+            static bool compare(const T& value, sqlite3_value* arg, int& cmp)
+            {
+                switch (sqlite3_value_type(arg)) {
+                    case SQLITE_INTEGER: {
+                        const auto a = static_cast<sqlite3_int64>(value);
+                        const auto b = sqlite3_value_int64(arg);
+                        cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+                        return true;
+                    }
+                    case SQLITE_FLOAT: {
+                        const auto a = static_cast<double>(value);
+                        const auto b = sqlite3_value_double(arg);
+                        cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+                        return true;
+                    }
+                    default: {
+                        return false;
+                    }
+                }
+            }
+        };
+
+        template<class T>
+        struct ColumnTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+        {
+            static const char* declType() { return "REAL"; }
+            static void result(sqlite3_context* ctx, const T& value)
+            {
+                sqlite3_result_double(ctx, static_cast<double>(value));
+            }
+            static bool compare(const T& value, sqlite3_value* arg, int& cmp)
+            {
+                const int type = sqlite3_value_type(arg);
+                if (SQLITE_INTEGER != type && SQLITE_FLOAT != type) {
+                    return false;
+                }
+                const auto a = static_cast<double>(value);
+                const auto b = sqlite3_value_double(arg);
+                cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+                return true;
+            }
+        };
+
+        template<>
+        struct ColumnTraits<QString>
+        {
+            static const char* declType() { return "TEXT"; }
+            static void result(sqlite3_context* ctx, const QString& value)
+            {
+                const QByteArray utf8 = value.toUtf8();
+                sqlite3_result_text(ctx, utf8.constData(), utf8.size(), SQLITE_TRANSIENT);
+            }
+            static bool compare(const QString& value, sqlite3_value* arg, int& cmp)
+            {
+                if (SQLITE_TEXT != sqlite3_value_type(arg)) {
+                    return false;
+                }
+                // BINARY 按 UTF-8 字节比较; QString::compare 按 UTF-16 码元, 两者对增补平面字符与 U+E000-U+FFFF 的顺序不同
+                const QByteArray utf8 = value.toUtf8();
+                const auto text = sqlite3_value_text(arg);
+                const int bytes = sqlite3_value_bytes(arg);
+                const int c = ::memcmp(utf8.constData(), text, static_cast<size_t>(std::min(utf8.size(), bytes)));
+                cmp = (c < 0) ? -1 : ((c > 0) ? 1 : ((utf8.size() < bytes) ? -1 : ((utf8.size() > bytes) ? 1 : 0)));
+                return true;
+            }
+        };
+
+        // std::string / QByteArray 直接引用容器内存, 不拷贝
+        template<>
+        struct ColumnTraits<std::string>
+        {
+            static const char* declType() { return "TEXT"; }
+            static void result(sqlite3_context* ctx, const std::string& value)
+            {
+                sqlite3_result_text(ctx, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+            }
+            static bool compare(const std::string& value, sqlite3_value* arg, int& cmp)
+            {
+                if (SQLITE_TEXT != sqlite3_value_type(arg)) {
+                    return false;
+                }
+                const auto text = reinterpret_cast<const char*>(sqlite3_value_text(arg));
+                const int c = value.compare(0, std::string::npos, text, sqlite3_value_bytes(arg));
+                cmp = (c < 0) ? -1 : ((c > 0) ? 1 : 0);
+                return true;
+            }
+        };
+
+        template<>
+        struct ColumnTraits<QByteArray>
+        {
+            static const char* declType() { return "BLOB"; }
+            static void result(sqlite3_context* ctx, const QByteArray& value)
+            {
+                sqlite3_result_blob(ctx, value.constData(), value.size(), SQLITE_STATIC);
+            }
+            static bool compare(const QByteArray&, sqlite3_value*, int&)
+            {
+                return false;
+            }
+        };
+    }
+
+    /**
+     * @brief 把内存中的随机访问容器 (如 std::vector<Struct>) 注册为 eponymous 虚拟表
+     *
+     * @code
+     * std::vector<Item> items = ...;          // 按 id 升序
+     * Sqlite3VTable<std::vector<Item>> vt(items);
+     * vt.key("id", &Item::id).column("name", &Item::name);
+     * vt.registerTo(db, "mem_items");
+     * Sqlite3Query q(db, "SELECT t.* FROM t JOIN mem_items m ON m.id = t.id;");
+     * @endcode
+     *
+     * @note 不拷贝数据: 查询期间 data 与本对象都必须存活且不被修改; 本对象析构后再查询该表返回错误;
+     *       key 列要求容器按 SQLite BINARY 的顺序升序排列 (数值按大小, 文本按 UTF-8 字节即 memcmp;
+     *       QString 须按 toUtf8() 的字节而不是 QString::operator< 排序), 只有 BINARY 排序规则的约束用于二分查找;
+     *       重新 connect 后需要再次 registerTo
+     */
+    template<class Range>
+    class Sqlite3VTable
+    {
+    public:
+        using Iterator = decltype(std::begin(std::declval<const Range&>()));
+        using Row = typename std::iterator_traits<Iterator>::value_type;
+
+        explicit Sqlite3VTable(const Range& data)
+            : mData(data), mLink(std::make_shared<Link>())
+        {
+            mLink->owner = this;
+        }
+        ~Sqlite3VTable()
+        {
+            mLink->owner = nullptr;
+        }
+        Sqlite3VTable(const Sqlite3VTable&) = delete;
+        Sqlite3VTable& operator=(const Sqlite3VTable&) = delete;
+
+        template<class M>
+        Sqlite3VTable& column(const QString& name, M Row::* member)
+        {
+            Column col;
+            col.name = name;
+            col.declType = vtab::ColumnTraits<M>::declType();
+            col.result = [member] (sqlite3_context* ctx, const Row& row) {
+                vtab::ColumnTraits<M>::result(ctx, row.*member);
+            };
+            mColumns.push_back(col);
+            return *this;
+        }
+
+        template<class M>
+        Sqlite3VTable& key(const QString& name, M Row::* member)
+        {
+            column(name, member);
+            mKeyColumn = static_cast<int>(mColumns.size()) - 1;
+            mKeyCompare = [member] (const Row& row, sqlite3_value* arg, int& cmp) {
+                return vtab::ColumnTraits<M>::compare(row.*member, arg, cmp);
+            };
+            return *this;
+        }
+
+        int registerTo(Sqlite3& db, const QString& name)
+        {
+            // 模块持有 mLink 的一份引用, 由 SQLite 在模块被替换或连接关闭时释放
+            return db.createModule(name, &module(), new std::shared_ptr<Link>(mLink), &destroyLink);
+        }
+
+    private:
+        enum IndexFlag
+        {
+            IndexEq = 0x01,
+            IndexGt = 0x02,
+            IndexGe = 0x04,
+            IndexLt = 0x08,
+            IndexLe = 0x10,
+        };
+
+        struct Column
+        {
+            QString                                                 name;
+            const char*                                             declType;
+            std::function<void(sqlite3_context*, const Row&)>       result;
+        };
+
+        // 模块与本对象共享, 本对象析构时 owner 置空
+        struct Link
+        {
+            Sqlite3VTable*          owner = nullptr;
+        };
+
+        struct Table
+        {
+            sqlite3_vtab            base;
+            Link*                   link;
+        };
+
+        struct Cursor
+        {
+            sqlite3_vtab_cursor     base;
+            size_t                  pos;
+            size_t                  end;
+        };
+
+        size_t size() const
+        {
+            return static_cast<size_t>(std::end(mData) - std::begin(mData));
+        }
+
+        static Sqlite3VTable* owner(sqlite3_vtab* vtab)
+        {
+            const auto self = reinterpret_cast<Table*>(vtab)->link->owner;
+            if (!self) {
+                sqlite3_free(vtab->zErrMsg);
+                vtab->zErrMsg = sqlite3_mprintf("virtual table data has been destroyed");
+            }
+            return self;
+        }
+
+        static void destroyLink(void* data)
+        {
+            delete static_cast<std::shared_ptr<Link>*>(data);
+        }
+
+        // 把 [pos, end) 收窄到满足 key op arg 的区间; 类型不可比较时保持原区间, 由 SQLite 复核
+        void narrow(int flag, sqlite3_value* arg, size_t& pos, size_t& end) const
+        {
+            if (SQLITE_NULL == sqlite3_value_type(arg)) {
+                pos = end;
+                return;
+            }
+            const auto begin = std::begin(mData);
+            int cmp = 0;
+            if (pos >= end || !mKeyCompare(*(begin + pos), arg, cmp)) {
+                return;
+            }
+            const auto& compare = mKeyCompare;
+            const auto less = [&] (const Row& row) { int c = 0; compare(row, arg, c); return c < 0; };
+            const auto lessEqual = [&] (const Row& row) { int c = 0; compare(row, arg, c); return c <= 0; };
+            if (flag & IndexGt) {
+                pos = static_cast<size_t>(std::partition_point(begin + pos, begin + end, lessEqual) - begin);
+            }
+            else if (flag & (IndexEq | IndexGe)) {
+                pos = static_cast<size_t>(std::partition_point(begin + pos, begin + end, less) - begin);
+            }
+            if (flag & IndexLt) {
+                end = static_cast<size_t>(std::partition_point(begin + pos, begin + end, less) - begin);
+            }
+            else if (flag & (IndexEq | IndexLe)) {
+                end = static_cast<size_t>(std::partition_point(begin + pos, begin + end, lessEqual) - begin);
+            }
+        }
+
+        static int xConnect(sqlite3* db, void* aux, int, const char* const*, sqlite3_vtab** ppVtab, char**)
+        {
+            const auto link = static_cast<std::shared_ptr<Link>*>(aux)->get();
+            const auto self = link->owner;
+            if (!self) {
+                return SQLITE_ERROR;
+            }
+            QString schema("CREATE TABLE x(");
+            for (size_t i = 0; i < self->mColumns.size(); ++i) {
+                if (i > 0) {
+                    schema.append(", ");
+                }
+                schema.append(QString("\"%1\" %2").arg(self->mColumns[i].name).arg(self->mColumns[i].declType));
+            }
+            schema.append(");");
+
+            const int rc = sqlite3_declare_vtab(db, schema.toUtf8().constData());
+            if (SQLITE_OK != rc) {
+                return rc;
+            }
+            auto table = static_cast<Table*>(sqlite3_malloc(sizeof(Table)));
+            if (!table) {
+                return SQLITE_NOMEM;
+            }
+            ::memset(table, 0, sizeof(Table));
+            table->link = link;
+            *ppVtab = &table->base;
+
+            return SQLITE_OK;
+        }
+
+        static int xDisconnect(sqlite3_vtab* vtab)
+        {
+            sqlite3_free(vtab);
+            return SQLITE_OK;
+        }
+
+        static int xBestIndex(sqlite3_vtab* vtab, sqlite3_index_info* info)
+        {
+            const auto self = owner(vtab);
+            if (!self) {
+                return SQLITE_ERROR;
+            }
+            const double rows = static_cast<double>(self->size());
+            int eq = -1, lower = -1, upper = -1, flags = 0;
+            for (int i = 0; self->mKeyColumn >= 0 && i < info->nConstraint; ++i) {
+                const auto& c = info->aConstraint[i];
+                if (!c.usable || c.iColumn != self->mKeyColumn) {
+                    continue;
+                }
+                // 二分查找按 C++ 的比较顺序, 只对应 BINARY; 其它排序规则交给 SQLite 逐行判断
+                const char* collation = sqlite3_vtab_collation(info, i);
+                if (collation && 0 != sqlite3_stricmp(collation, "BINARY")) {
+                    continue;
+                }
+                switch (c.op) {
+                    case SQLITE_INDEX_CONSTRAINT_EQ: {
+                        if (eq < 0) { eq = i; }
+                        break;
+                    }
+                    case SQLITE_INDEX_CONSTRAINT_GT:
+                    case SQLITE_INDEX_CONSTRAINT_GE: {
+                        if (lower < 0) { lower = i; }
+                        break;
+                    }
+                    case SQLITE_INDEX_CONSTRAINT_LT:
+                    case SQLITE_INDEX_CONSTRAINT_LE: {
+                        if (upper < 0) { upper = i; }
+                        break;
+                    }
+                    default: {
+                        break;
+                    }
+                }
+            }
+
+            // argv 顺序与 xFilter 中的解析顺序一致: Eq | (Gt/Ge, Lt/Le)
+            const double probe = std::log2(rows + 1) + 1;
+            if (eq >= 0) {
+                flags = IndexEq;
+                info->aConstraintUsage[eq].argvIndex = 1;
+                info->estimatedCost = probe;
+                info->estimatedRows = 1;
+            }
+            else if (lower >= 0 || upper >= 0) {
+                int argv = 0;
+                if (lower >= 0) {
+                    flags |= (SQLITE_INDEX_CONSTRAINT_GT == info->aConstraint[lower].op) ? IndexGt : IndexGe;
+                    info->aConstraintUsage[lower].argvIndex = ++argv;
+                }
+                if (upper >= 0) {
+                    flags |= (SQLITE_INDEX_CONSTRAINT_LT == info->aConstraint[upper].op) ? IndexLt : IndexLe;
+                    info->aConstraintUsage[upper].argvIndex = ++argv;
+                }
+                const double estimated = rows / ((lower >= 0 && upper >= 0) ? 16 : 4);
+                info->estimatedCost = probe + estimated;
+                info->estimatedRows = static_cast<sqlite3_int64>(estimated) + 1;
+            }
+            else {
+                info->estimatedCost = rows + 1;
+                info->estimatedRows = static_cast<sqlite3_int64>(rows);
+            }
+            info->idxNum = flags;
+
+            if (self->mKeyColumn >= 0 && 1 == info->nOrderBy
+                && info->aOrderBy[0].iColumn == self->mKeyColumn && !info->aOrderBy[0].desc) {
+                info->orderByConsumed = 1;
+            }
+
+            return SQLITE_OK;
+        }
+
+        static int xOpen(sqlite3_vtab*, sqlite3_vtab_cursor** ppCursor)
+        {
+            auto cur = static_cast<Cursor*>(sqlite3_malloc(sizeof(Cursor)));
+            if (!cur) {
+                return SQLITE_NOMEM;
+            }
+            ::memset(cur, 0, sizeof(Cursor));
+            *ppCursor = &cur->base;
+
+            return SQLITE_OK;
+        }
+
+        static int xClose(sqlite3_vtab_cursor* cur)
+        {
+            sqlite3_free(cur);
+            return SQLITE_OK;
+        }
+
+        static int xFilter(sqlite3_vtab_cursor* base, int idxNum, const char*, int argc, sqlite3_value** argv)
+        {
+            auto cur = reinterpret_cast<Cursor*>(base);
+            auto self = owner(base->pVtab);
+            if (!self) {
+                return SQLITE_ERROR;
+            }
+            cur->pos = 0;
+            cur->end = self->size();
+
+            int arg = 0;
+            const int flags[] = { IndexEq, IndexGt | IndexGe, IndexLt | IndexLe };
+            for (const int mask : flags) {
+                if ((idxNum & mask) && arg < argc) {
+                    self->narrow(idxNum & mask, argv[arg++], cur->pos, cur->end);
+                }
+            }
+
+            return SQLITE_OK;
+        }
+
+        static int xNext(sqlite3_vtab_cursor* base)
+        {
+            ++reinterpret_cast<Cursor*>(base)->pos;
+            return SQLITE_OK;
+        }
+
+        static int xEof(sqlite3_vtab_cursor* base)
+        {
+            const auto cur = reinterpret_cast<Cursor*>(base);
+            return cur->pos >= cur->end;
+        }
+
+        static int xColumn(sqlite3_vtab_cursor* base, sqlite3_context* ctx, int idx)
+        {
+            const auto cur = reinterpret_cast<Cursor*>(base);
+            const auto self = owner(base->pVtab);
+            if (!self) {
+                return SQLITE_ERROR;
+            }
+            self->mColumns[idx].result(ctx, *(std::begin(self->mData) + cur->pos));
+            return SQLITE_OK;
+        }
+
+        static int xRowid(sqlite3_vtab_cursor* base, sqlite3_int64* rowid)
+        {
+            *rowid = static_cast<sqlite3_int64>(reinterpret_cast<Cursor*>(base)->pos);
+            return SQLITE_OK;
+        }
+
+        // xCreate 为空: 只能以 eponymous 方式使用, 无需 CREATE VIRTUAL TABLE
+        static const sqlite3_module& module()
+        {
+            static const sqlite3_module m = [] {
+                sqlite3_module mod;
+                ::memset(&mod, 0, sizeof(mod));
+                mod.iVersion = 1;
+                mod.xCreate = nullptr;
+                mod.xConnect = &Sqlite3VTable::xConnect;
+                mod.xBestIndex = &Sqlite3VTable::xBestIndex;
+                mod.xDisconnect = &Sqlite3VTable::xDisconnect;
+                mod.xDestroy = &Sqlite3VTable::xDisconnect;
+                mod.xOpen = &Sqlite3VTable::xOpen;
+                mod.xClose = &Sqlite3VTable::xClose;
+                mod.xFilter = &Sqlite3VTable::xFilter;
+                mod.xNext = &Sqlite3VTable::xNext;
+                mod.xEof = &Sqlite3VTable::xEof;
+                mod.xColumn = &Sqlite3VTable::xColumn;
+                mod.xRowid = &Sqlite3VTable::xRowid;
+                return mod;
+            }();
+            return m;
+        }
+
+    private:
+        const Range&                                                mData;
+        std::vector<Column>                                         mColumns;
+        int                                                         mKeyColumn = -1;
+        std::function<bool(const Row&, sqlite3_value*, int&)>       mKeyCompare;
+        std::shared_ptr<Link>                                       mLink;
+    };
+}
+
+#endif // sqlite3_wrap_SQLITE_3_VTAB_H
@@ -4,16 +4,205 @@
 
 #include "sqlite3-wrap.h"
 
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+
 #include <QFile>
+#include <QMap>
 #include <QDebug>
+#include <QFileInfo>
+#include <QDataStream>
 #include <QMutex>
 #include <QLockFile>
 
+#include <zlib.h>
 #include <sqlite3.h>
 
 
 namespace sqlite3_wrap
 {
+    static QVariant toVariant(sqlite3_value* value)
+    {
+        switch (sqlite3_value_type(value)) {
+            case SQLITE_INTEGER: {
+                return QVariant(static_cast<qint64>(sqlite3_value_int64(value)));
+            }
+            case SQLITE_FLOAT: {
+                return QVariant(sqlite3_value_double(value));
+            }
+            case SQLITE_TEXT: {
+                const auto text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+                return QVariant(QString::fromUtf8(text, sqlite3_value_bytes(value)));
+            }
+            case SQLITE_BLOB: {
+                const auto blob = static_cast<const char*>(sqlite3_value_blob(value));
+                return QVariant(QByteArray(blob, sqlite3_value_bytes(value)));
+            }
+            default: {
+                return QVariant();
+            }
+        }
+    }
+
+    static qint64 steadyMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int queryInt(sqlite3* db, const char* sql)
+    {
+        sqlite3_stmt* stmt = nullptr;
+        int value = -1;
+        if (SQLITE_OK == sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) && SQLITE_ROW == sqlite3_step(stmt)) {
+            value = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        return value;
+    }
+
+    // 键集分页语句: withKey 为 false 时是首页
+    static QString cursorSql(const QString& query, const QStringList& keyColumns, bool descending, bool withKey)
+    {
+        QStringList keys;
+        QStringList params;
+        QStringList orders;
+        for (int i = 0; i < keyColumns.size(); ++i) {
+            keys.append(QString("\"%1\"").arg(keyColumns.at(i)));
+            params.append(QString(":cursor_k%1").arg(i));
+            orders.append(keys.last() + (descending ? " DESC" : " ASC"));
+        }
+
+        QString inner = query.trimmed();
+        while (inner.endsWith(";")) {
+            inner.chop(1);
+        }
+
+        QString sql = QString("SELECT * FROM (%1)").arg(inner);
+        if (withKey) {
+            sql.append(QString(" WHERE (%1) %2 (%3)").arg(keys.join(", ")).arg(descending ? "<" : ">").arg(params.join(", ")));
+        }
+        sql.append(QString(" ORDER BY %1 LIMIT :cursor_limit;").arg(orders.join(", ")));
+
+        return sql;
+    }
+
+    // qCompress() 兼容格式: 4 字节大端原始长度 + zlib 流; out 由调用方复用
+    static bool compressValue(const char* data, int size, int level, std::vector<unsigned char>& out)
+    {
+        uLongf len = compressBound(static_cast<uLong>(size));
+        out.resize(len + 4);
+        out[0] = static_cast<unsigned char>((size >> 24) & 0xFF);
+        out[1] = static_cast<unsigned char>((size >> 16) & 0xFF);
+        out[2] = static_cast<unsigned char>((size >> 8) & 0xFF);
+        out[3] = static_cast<unsigned char>(size & 0xFF);
+        if (Z_OK != compress2(out.data() + 4, &len, reinterpret_cast<const Bytef*>(data), static_cast<uLong>(size), level)) {
+            return false;
+        }
+        out.resize(len + 4);
+
+        return true;
+    }
+
+    static bool decompressValue(const void* data, int size, std::vector<char>& out)
+    {
+        const auto p = static_cast<const unsigned char*>(data);
+        if (!p || size < 4) {
+            return false;
+        }
+        const uLong expected = (static_cast<uLong>(p[0]) << 24) | (static_cast<uLong>(p[1]) << 16)
+                             | (static_cast<uLong>(p[2]) << 8) | static_cast<uLong>(p[3]);
+        // SQLITE_MAX_LENGTH 的默认值, 防止损坏的长度头导致超大分配
+        if (expected > 1000000000UL) {
+            return false;
+        }
+
+        out.resize(qMax<uLong>(expected, 1));
+        uLongf len = expected;
+        if (Z_OK != uncompress(reinterpret_cast<Bytef*>(out.data()), &len, p + 4, static_cast<uLong>(size - 4)) || len != expected) {
+            return false;
+        }
+        out.resize(len);
+
+        return true;
+    }
+
+    // wrap_decompress(x): BLOB 解压为 TEXT, 其它类型原样返回
+    static void decompressFunction(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+    {
+        if (SQLITE_BLOB != sqlite3_value_type(argv[0])) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+
+        static thread_local std::vector<char> buffer;
+        if (!decompressValue(sqlite3_value_blob(argv[0]), sqlite3_value_bytes(argv[0]), buffer)) {
+            sqlite3_result_error(ctx, "wrap_decompress: corrupt compressed value", -1);
+            return;
+        }
+        sqlite3_result_text(ctx, buffer.data(), static_cast<int>(buffer.size()), SQLITE_TRANSIENT);
+    }
+
+    // wrap_compress(x [, threshold]): 与 bindCompressed() 规则相同, 用于迁移已有数据
+    static void compressFunction(sqlite3_context* ctx, int argc, sqlite3_value** argv)
+    {
+        if (SQLITE_TEXT != sqlite3_value_type(argv[0])) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+
+        const auto text = reinterpret_cast<const char*>(sqlite3_value_text(argv[0]));
+        const int size = sqlite3_value_bytes(argv[0]);
+        const int threshold = (argc > 1) ? sqlite3_value_int(argv[1]) : Sqlite3Codec().threshold;
+
+        static thread_local std::vector<unsigned char> buffer;
+        if (size >= threshold && compressValue(text, size, Z_DEFAULT_COMPRESSION, buffer) && buffer.size() < static_cast<size_t>(size)) {
+            sqlite3_result_blob(ctx, buffer.data(), static_cast<int>(buffer.size()), SQLITE_TRANSIENT);
+            return;
+        }
+        sqlite3_result_value(ctx, argv[0]);
+    }
+
+    // 计划表的键: 去掉首尾空白与结尾的分号
+    static QString normalizeSql(const char* sql)
+    {
+        QString key = QString::fromUtf8(sql ? sql : "").trimmed();
+        while (key.endsWith(";")) {
+            key.chop(1);
+            key = key.trimmed();
+        }
+
+        return key;
+    }
+
+    // "SCAN t" / 旧版本的 "SCAN TABLE t" 是全表扫描; 使用索引、常量行、虚拟表与子查询的 SCAN 不算
+    static bool isFullScan(const QString& detail)
+    {
+        return detail.startsWith("SCAN ")
+            && !detail.contains(" USING ")
+            && !detail.contains("CONSTANT ROW")
+            && !detail.contains("VIRTUAL TABLE")
+            && !detail.contains("SUBQUERY")
+            && !detail.contains("(subquery-");
+    }
+
+    // 有界队列两端的等待: 先自旋, 再让出, 等待较久时短暂休眠以免空转
+    static void backoff(int& spins)
+    {
+        if (++spins < 64) {
+            return;
+        }
+        if (spins < 256) {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
     class Sqlite3Private
     {
         Q_DECLARE_PUBLIC(Sqlite3)
@@ -23,13 +212,65 @@ namespace sqlite3_wrap
         ~Sqlite3Private();
         void disconnect();
         int connect(const QString& dbName, int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+        int connectImmutable(const QString& dbName, const Sqlite3ImmutableOptions& options);
+        int connectHybrid(const QString& dbName, const Sqlite3HybridOptions& options);
+        int flush();
         int execute(const QString& sql);
+        int step(sqlite3_stmt* stmt);                           // 所有经过封装的 sqlite3_step 都走这里, 用于确认变更是否真正提交
         bool checkTableIsExist(const QString& tableName);
         bool checkTableKeyIsExist(const QString& tableName, const QString& fieldName, qint64 key);
         bool checkTableKeyIsExist(const QString& tableName, const QString& fieldName, const QString& key);
+        int createModule(const QString& name, const sqlite3_module* module, void* clientData, void (*destroy)(void*));
 
         void lockForWrite();
         void unlockForWrite();
+        Sqlite3LockStatistics lockStatistics() const;
+        void resetLockStatistics();
+
+        std::shared_ptr<Sqlite3ChangeFeed> subscribeChanges(int capacity, bool withValues);
+        void unsubscribeChanges(const std::shared_ptr<Sqlite3ChangeFeed>& feed);
+
+        int startMaintenance(const Sqlite3MaintenanceOptions& options);
+        void stopMaintenance();
+        Sqlite3MaintenanceStatistics maintenanceStatistics() const;
+
+        void touch();
+
+    private:
+        bool isIdle(const Sqlite3MaintenanceOptions& options) const;
+        void lockForMaintenance();                              // 与 lockForWrite() 相同的锁, 但不计入活跃时间与锁统计
+        void unlockForMaintenance();
+        void maintenanceLoop(sqlite3* db);
+        void runCheckpoint(sqlite3* db, const Sqlite3MaintenanceOptions& options);
+        void runVacuum(sqlite3* db, const Sqlite3MaintenanceOptions& options);
+        void runOptimize(sqlite3* db, const Sqlite3MaintenanceOptions& options);
+        void recordTask(Sqlite3MaintenanceTaskStatistics Sqlite3MaintenanceStatistics::* task, std::chrono::steady_clock::time_point start, int rc);
+        static int progressHandler(void* data);
+
+        void setPlanCheck(Sqlite3QueryPlan::Check check);
+        void markHot(const QString& sql);
+        QList<Sqlite3QueryPlan> queryPlans() const;
+        void resetQueryPlans();
+        int inspectPlan(sqlite3_stmt* stmt);                    // prepare 成功后调用
+        void recordPlanStatus(sqlite3_stmt* stmt);              // finalize 之前调用
+        QString planError() const;
+        void clearPlanError();                                  // 每次 prepare 之前调用, 避免残留上一条语句的失败原因
+
+    private:
+        void stopFlush();
+        void flushLoop();
+        int flush(bool force);
+        void capturePlan(Sqlite3QueryPlan& plan);
+        void registerFunctions();
+        void installChangeHooks(bool enable);
+        void publishChanges();
+        void trackSavepoint(const char* sql);
+        static void updateHook(void* data, int op, const char* database, const char* table, sqlite3_int64 rowid);
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        static void preupdateHook(void* data, sqlite3* db, int op, const char* database, const char* table, sqlite3_int64 rowid, sqlite3_int64 newRowid);
+#endif
+        static int commitHook(void* data);
+        static void rollbackHook(void* data);
 
     private:
         bool                            mShowSQL;
@@ -39,6 +280,45 @@ namespace sqlite3_wrap
 
         std::unique_ptr<QLockFile>      mLocker;                // 读写时候需要操作数据库，进程锁
         QMutex                          mMutexLocker;           // 线程锁
+        bool                            mImmutable = false;     // connectImmutable() 打开, 不加任何锁
+        bool                            mHybrid = false;        // connectHybrid() 打开, 写入不加进程锁
+
+        std::atomic<quint64>            mLockAcquisitions;      // 写锁统计
+        std::atomic<quint64>            mLockWaitNs;
+        std::atomic<quint64>            mLockMaxWaitNs;
+
+        QMutex                                              mFeedLocker;            // 保护 mFeeds
+        std::vector<std::shared_ptr<Sqlite3ChangeFeed>>     mFeeds;
+        std::atomic<bool>                                   mFeedValues;
+        std::atomic<bool>                                   mTrackChanges;
+        std::vector<Sqlite3Change>                          mPendingChanges;        // 当前事务内的变更, 只在持有连接互斥锁时访问
+        std::vector<Sqlite3Change>                          mCommittingChanges;     // commit hook 已触发, 等待确认提交成功
+        std::vector<std::pair<QString, size_t>>             mSavepoints;            // savepoint 名称及其在 mPendingChanges 中的位置
+        bool                                                mRolledBack = false;    // 本次 step 期间是否触发了 rollback hook
+
+        std::atomic<bool>               mMaintenanceRunning;    // 未启动维护线程时 touch() 不记录活跃时间
+        std::atomic<qint64>             mLastActivityMs;        // 最近一次读写 (steady clock), 用于判断空闲
+        std::thread                     mMaintenanceThread;
+        mutable QMutex                  mMaintenanceLocker;     // 保护维护线程的参数、统计与停止标志
+        QWaitCondition                  mMaintenanceCondition;
+        bool                            mMaintenanceStop = false;
+        Sqlite3MaintenanceOptions       mMaintenanceOptions;
+        Sqlite3MaintenanceStatistics    mMaintenanceStatistics;
+
+        sqlite3*                        mDiskDB = nullptr;      // 混合模式下的磁盘连接, 只用于载入和写回
+        Sqlite3HybridOptions            mHybridOptions;
+        std::thread                     mFlushThread;
+        QMutex                          mFlushLocker;           // 串行化 flush()
+        QMutex                          mFlushStateLocker;      // 保护停止标志
+        QWaitCondition                  mFlushCondition;
+        bool                            mFlushStop = false;
+        qint64                          mFlushedChanges = -1;   // 上次写回时的 total_changes + schema_version
+
+        std::atomic<int>                    mPlanCheck;
+        mutable QMutex                      mPlanLocker;        // 保护下面三项
+        QMap<QString, Sqlite3QueryPlan>     mPlans;
+        QStringList                         mHotSql;
+        QString                             mPlanError;         // 最近一次 Strict 检查失败的原因
 
         Sqlite3*                        q_ptr = nullptr;
     };
@@ -46,7 +326,7 @@ namespace sqlite3_wrap
 
 
 sqlite3_wrap::Sqlite3Private::Sqlite3Private(bool showSQL, Sqlite3* q)
-    : mShowSQL(showSQL), q_ptr(q)
+    : mShowSQL(showSQL), mLockAcquisitions(0), mLockWaitNs(0), mLockMaxWaitNs(0), mFeedValues(false), mTrackChanges(false), mMaintenanceRunning(false), mLastActivityMs(0), mPlanCheck(Sqlite3QueryPlan::Off), q_ptr(q)
 {
 
 }
@@ -58,6 +338,13 @@ sqlite3_wrap::Sqlite3Private::~Sqlite3Private()
 
 void sqlite3_wrap::Sqlite3Private::disconnect()
 {
+    // 维护线程会获取 mMutexLocker, 必须在加锁之前停止
+    stopMaintenance();
+    stopFlush();
+    if (mHybrid && SQLITE_OK != flush(true)) {
+        qWarning() << "disconnect --> final flush of " << mDBName << " failed: " << sqlite3_errmsg(mDiskDB);
+    }
+
     mMutexLocker.lock();
 
     mDBName.clear();
@@ -65,7 +352,14 @@ void sqlite3_wrap::Sqlite3Private::disconnect()
         sqlite3_close(mDB);
         mDB = nullptr;
     }
+    if (mDiskDB) {
+        sqlite3_close(mDiskDB);
+        mDiskDB = nullptr;
+    }
     mLocker.reset(nullptr);
+    mImmutable = false;
+    mHybrid = false;
+    mFlushedChanges = -1;
 
     mMutexLocker.unlock();
 }
@@ -86,24 +380,348 @@ int sqlite3_wrap::Sqlite3Private::connect(const QString & dbName, int flags)
     sqlite3* db = nullptr;
     const int ret = sqlite3_open_v2(mDBName.toUtf8().constData(), &db, flags, nullptr);
     mDB = db;
+    touch();
+    if (SQLITE_OK == ret) {
+        registerFunctions();
+    }
+
+    bool hasFeeds = false;
+    {
+        QMutexLocker feedLocker(&mFeedLocker);
+        hasFeeds = !mFeeds.empty();
+    }
+    if (SQLITE_OK == ret && hasFeeds) {
+        installChangeHooks(true);
+    }
+
+    return ret;
+}
+
+int sqlite3_wrap::Sqlite3Private::connectImmutable(const QString & dbName, const Sqlite3ImmutableOptions & options)
+{
+    disconnect();
+
+    QMutexLocker locker(&mMutexLocker);
+    mDBName = dbName;
+    if (!mDBName.endsWith(".sqlite")) {
+        mDBName.append(".sqlite");
+    }
+    mImmutable = true;
+    touch();
+
+    if (Sqlite3ImmutableOptions::PreloadNone != options.preload) {
+        QFile file(mDBName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "connectImmutable --> open " << mDBName << " failed: " << file.errorString();
+            return SQLITE_CANTOPEN;
+        }
+
+        if (Sqlite3ImmutableOptions::PreloadMemory == options.preload) {
+            // FREEONCLOSE 要求缓冲区来自 sqlite3_malloc64()
+            const qint64 size = file.size();
+            auto data = static_cast<char*>(sqlite3_malloc64(static_cast<sqlite3_uint64>(qMax<qint64>(size, 1))));
+            if (!data) {
+                return SQLITE_NOMEM;
+            }
+            if (file.read(data, size) != size) {
+                qWarning() << "connectImmutable --> read " << mDBName << " failed: " << file.errorString();
+                sqlite3_free(data);
+                return SQLITE_IOERR;
+            }
+
+            sqlite3* db = nullptr;
+            int ret = sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE, nullptr);
+            mDB = db;
+            if (SQLITE_OK != ret) {
+                sqlite3_free(data);
+                return ret;
+            }
+            ret = sqlite3_deserialize(mDB, "main", reinterpret_cast<unsigned char*>(data), size, size,
+                                      SQLITE_DESERIALIZE_READONLY | SQLITE_DESERIALIZE_FREEONCLOSE);
+            if (SQLITE_OK == ret) {
+                registerFunctions();
+            }
+            return ret;
+        }
+
+        // 只为让文件进入页缓存, 读到的内容直接丢弃
+        char buf[1 << 16];
+        while (file.read(buf, sizeof(buf)) > 0) {
+        }
+    }
+
+    // URI 中 % ? # 有特殊含义
+    QString path = mDBName;
+    path.replace("%", "%25").replace("?", "%3f").replace("#", "%23");
+    const QString uri = QString("file:%1?immutable=1&mode=ro").arg(path);
+
+    sqlite3* db = nullptr;
+    int ret = sqlite3_open_v2(uri.toUtf8().constData(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, nullptr);
+    mDB = db;
+    if (SQLITE_OK == ret) {
+        registerFunctions();
+    }
+    if (SQLITE_OK == ret && options.mmapSize > 0) {
+        ret = sqlite3_exec(mDB, QString("PRAGMA mmap_size = %1;").arg(options.mmapSize).toUtf8().constData(), nullptr, nullptr, nullptr);
+    }
 
     return ret;
 }
 
+int sqlite3_wrap::Sqlite3Private::connectHybrid(const QString & dbName, const Sqlite3HybridOptions & options)
+{
+    disconnect();
+
+    QMutexLocker locker(&mMutexLocker);
+    mDBName = dbName;
+    if (!mDBName.endsWith(".sqlite")) {
+        mDBName.append(".sqlite");
+    }
+    QString dbNameT = mDBName;
+    dbNameT.replace('.', '-').replace("/", "-");
+    mLocker.reset(new QLockFile(QString("/tmp/sqlite3-db-%1.lock").arg(dbNameT)));
+    mHybridOptions = options;
+
+    sqlite3* disk = nullptr;
+    int ret = sqlite3_open_v2(mDBName.toUtf8().constData(), &disk, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    mDiskDB = disk;
+    if (SQLITE_OK != ret) {
+        return ret;
+    }
+    sqlite3_busy_timeout(mDiskDB, qMax(options.busyTimeoutMs, 0));
+
+    sqlite3* db = nullptr;
+    ret = sqlite3_open_v2(":memory:", &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    mDB = db;
+    touch();
+    if (SQLITE_OK != ret) {
+        return ret;
+    }
+
+    // 用临时连接载入: sqlite3_backup_init() 按 源 -> 目标 的顺序获取连接互斥量,
+    // 与 flush() 在同一对连接上方向相反
+    sqlite3* source = nullptr;
+    mLocker->lock();
+    ret = sqlite3_open_v2(mDBName.toUtf8().constData(), &source, SQLITE_OPEN_READONLY, nullptr);
+    if (SQLITE_OK == ret) {
+        sqlite3_backup* backup = sqlite3_backup_init(mDB, "main", source, "main");
+        if (backup) {
+            sqlite3_backup_step(backup, -1);
+            ret = sqlite3_backup_finish(backup);
+        }
+        else {
+            ret = sqlite3_errcode(mDB);
+        }
+    }
+    sqlite3_close(source);
+    mLocker->unlock();
+    if (SQLITE_OK != ret) {
+        qWarning() << "connectHybrid --> load " << mDBName << " failed: " << sqlite3_errmsg(mDB);
+        return ret;
+    }
+    mHybrid = true;
+    mFlushedChanges = sqlite3_total_changes(mDB) + queryInt(mDB, "PRAGMA schema_version;");
+
+    registerFunctions();
+    bool hasFeeds = false;
+    {
+        QMutexLocker feedLocker(&mFeedLocker);
+        hasFeeds = !mFeeds.empty();
+    }
+    if (hasFeeds) {
+        installChangeHooks(true);
+    }
+
+    if (options.flushIntervalMs > 0) {
+        QMutexLocker stateLocker(&mFlushStateLocker);
+        mFlushStop = false;
+        mFlushThread = std::thread(&Sqlite3Private::flushLoop, this);
+    }
+
+    return SQLITE_OK;
+}
+
+int sqlite3_wrap::Sqlite3Private::flush()
+{
+    return flush(true);
+}
+
+int sqlite3_wrap::Sqlite3Private::flush(bool force)
+{
+    QMutexLocker flushLocker(&mFlushLocker);
+    if (!mHybrid || !mDB || !mDiskDB) {
+        return SQLITE_MISUSE;
+    }
+
+    // 持有写入线程锁取一份已提交内容的快照, 写入最多被阻塞一次内存拷贝的时间, 也不会因为并发写入而重来;
+    // 内存库处于写事务中时等事务结束, 保证不会写出未提交的数据
+    const qint64 deadline = steadyMs() + qMax(mHybridOptions.busyTimeoutMs, 0);
+    qint64 changes = 0;
+    sqlite3_int64 size = 0;
+    unsigned char* data = nullptr;
+    while (true) {
+        {
+            QMutexLocker locker(&mMutexLocker);
+            sqlite3_mutex* mutex = sqlite3_db_mutex(mDB);
+            sqlite3_mutex_enter(mutex);
+            const bool idle = (SQLITE_TXN_WRITE != sqlite3_txn_state(mDB, "main"));
+            if (idle) {
+                changes = sqlite3_total_changes(mDB) + queryInt(mDB, "PRAGMA schema_version;");
+                if (force || changes != mFlushedChanges) {
+                    data = sqlite3_serialize(mDB, "main", &size, 0);
+                }
+            }
+            sqlite3_mutex_leave(mutex);
+            if (idle) {
+                break;
+            }
+        }
+        if (steadyMs() >= deadline) {
+            return SQLITE_BUSY;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 没有任何修改时跳过周期写回
+    if (!force && changes == mFlushedChanges) {
+        return SQLITE_OK;
+    }
+    if (!data) {
+        return SQLITE_NOMEM;
+    }
+
+    // 快照失败时 sqlite3_deserialize() 负责释放 data
+    sqlite3* snapshot = nullptr;
+    int rc = sqlite3_open_v2(":memory:", &snapshot, SQLITE_OPEN_READWRITE, nullptr);
+    if (SQLITE_OK == rc) {
+        rc = sqlite3_deserialize(snapshot, "main", data, size, size, SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_READONLY);
+    }
+    else {
+        sqlite3_free(data);
+    }
+
+    // 磁盘文件在写回期间对其它进程表现为一个普通的写事务
+    if (SQLITE_OK == rc && !mLocker->tryLock(static_cast<int>(qMax<qint64>(deadline - steadyMs(), 0)))) {
+        rc = SQLITE_BUSY;
+    }
+    else if (SQLITE_OK == rc) {
+        sqlite3_backup* backup = sqlite3_backup_init(mDiskDB, "main", snapshot, "main");
+        if (backup) {
+            rc = sqlite3_backup_step(backup, -1);
+            const int finishRc = sqlite3_backup_finish(backup);
+            rc = (SQLITE_DONE == rc) ? finishRc : rc;
+        }
+        else {
+            rc = sqlite3_errcode(mDiskDB);
+        }
+        mLocker->unlock();
+    }
+    sqlite3_close(snapshot);
+
+    if (SQLITE_OK == rc) {
+        mFlushedChanges = changes;
+    }
+
+    return rc;
+}
+
+void sqlite3_wrap::Sqlite3Private::stopFlush()
+{
+    {
+        QMutexLocker locker(&mFlushStateLocker);
+        mFlushStop = true;
+        mFlushCondition.wakeAll();
+    }
+    if (mFlushThread.joinable()) {
+        mFlushThread.join();
+    }
+}
+
+void sqlite3_wrap::Sqlite3Private::flushLoop()
+{
+    QMutexLocker locker(&mFlushStateLocker);
+    while (!mFlushStop) {
+        mFlushCondition.wait(&mFlushStateLocker, static_cast<unsigned long>(mHybridOptions.flushIntervalMs));
+        if (mFlushStop) {
+            break;
+        }
+        locker.unlock();
+
+        const int rc = flush(false);
+        if (SQLITE_OK != rc) {
+            qWarning() << "flushLoop --> flush " << mDBName << " failed: " << rc;
+        }
+
+        locker.relock();
+    }
+}
+
 int sqlite3_wrap::Sqlite3Private::execute(const QString & sql)
 {
     lockForWrite();
     // qDebug() << "Executing " << sql << "...";
-    const int ret = sqlite3_exec(mDB, sql.toUtf8().constData(), nullptr, nullptr, nullptr);
+    // 与 sqlite3_exec 相同的逐条执行, 但每条语句都经过 step(), 以便跟踪语句失败与 savepoint
+    const QByteArray utf8 = sql.toUtf8();
+    const char* tail = utf8.constData();
+    int ret = SQLITE_OK;
+    while (SQLITE_OK == ret && tail && *tail) {
+        sqlite3_stmt* stmt = nullptr;
+        clearPlanError();
+        ret = sqlite3_prepare_v2(mDB, tail, -1, &stmt, &tail);
+        if (SQLITE_OK != ret || !stmt) {
+            break;                                              // 剩余部分只有空白或注释
+        }
+        while (SQLITE_ROW == (ret = step(stmt))) {
+        }
+        sqlite3_finalize(stmt);
+        if (SQLITE_DONE == ret) {
+            ret = SQLITE_OK;
+        }
+    }
     unlockForWrite();
 
     return ret;
 }
 
+int sqlite3_wrap::Sqlite3Private::step(sqlite3_stmt* stmt)
+{
+    if (!mTrackChanges) {
+        return sqlite3_step(stmt);
+    }
+
+    // hook 都在连接互斥锁 (可重入) 内回调, 这里一并持有, 让 step 前后的变更位置与 hook 保持一致
+    sqlite3_mutex* mutex = sqlite3_db_mutex(mDB);
+    sqlite3_mutex_enter(mutex);
+    const bool first = !sqlite3_stmt_busy(stmt);
+    const size_t mark = mPendingChanges.size();
+    const int total = sqlite3_total_changes(mDB);
+    mRolledBack = false;
+    const int rc = sqlite3_step(stmt);
+    if (SQLITE_ROW == rc || SQLITE_DONE == rc) {
+        if (first) {
+            trackSavepoint(sqlite3_sql(stmt));
+        }
+    }
+    else if (!mRolledBack && total == sqlite3_total_changes(mDB) && mPendingChanges.size() > mark) {
+        // 默认的 ABORT 会撤销语句自身的修改, 此时 SQLite 把本语句的修改计数清零;
+        // OR FAIL / RAISE(FAIL) 保留冲突之前已修改的行, 计数照常累加, 变更也要保留
+        mPendingChanges.erase(mPendingChanges.begin() + mark, mPendingChanges.end());
+    }
+
+    // 回到自动提交状态且没有触发回滚, 说明提交已经完成; 与 step 的返回值无关 (OR FAIL 出错时仍会提交)
+    if (!mCommittingChanges.empty() && !mRolledBack && sqlite3_get_autocommit(mDB)) {
+        publishChanges();
+    }
+    sqlite3_mutex_leave(mutex);
+
+    return rc;
+}
+
 bool sqlite3_wrap::Sqlite3Private::checkTableIsExist(const QString & tableName)
 {
     lockForWrite();
     sqlite3_stmt* stmt = nullptr;
+    clearPlanError();
     const int res = sqlite3_prepare_v2(mDB, "SELECT name FROM sqlite_master WHERE type='table' AND name = ?;", -1, &stmt, nullptr);
     if (res != SQLITE_OK) {
         unlockForWrite();
@@ -122,15 +740,24 @@ bool sqlite3_wrap::Sqlite3Private::checkTableKeyIsExist(const QString & tableNam
 {
     lockForWrite();
     sqlite3_stmt* stmt = nullptr;
+    clearPlanError();
     const int res = sqlite3_prepare_v2(mDB,
-        QString("SELECT %1 FROM %2 WHERE %3 = %4;")
-        .arg(fieldName).arg(tableName).arg(fieldName).arg(key).toUtf8().constData(), -1, &stmt, nullptr);
+        QString("SELECT %1 FROM %2 WHERE %1 = ?;").arg(fieldName).arg(tableName).toUtf8().constData(),
+        -1, &stmt, nullptr);
     if (res != SQLITE_OK) {
         unlockForWrite();
         qWarning() << "sqlite3_prepare_v2 failed: " << sqlite3_errmsg(mDB);
         return false;
     }
+    if (SQLITE_OK != inspectPlan(stmt)) {
+        sqlite3_finalize(stmt);
+        unlockForWrite();
+        qWarning() << "checkTableKeyIsExist --> " << planError();
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, key);
     const int rc = sqlite3_step(stmt);
+    recordPlanStatus(stmt);
     sqlite3_finalize(stmt);
     unlockForWrite();
 
@@ -141,6 +768,7 @@ bool sqlite3_wrap::Sqlite3Private::checkTableKeyIsExist(const QString & tableNam
 {
     lockForWrite();
     sqlite3_stmt* stmt = nullptr;
+    clearPlanError();
 
     const int res = sqlite3_prepare_v2(mDB,
         QString("SELECT %1 FROM %2 WHERE %1 = ?;").arg(fieldName).arg(tableName).toUtf8().constData(),
@@ -150,24 +778,642 @@ bool sqlite3_wrap::Sqlite3Private::checkTableKeyIsExist(const QString & tableNam
         qWarning() << "sqlite3_prepare_v2 failed: " << sqlite3_errmsg(mDB);
         return false;
     }
-    sqlite3_bind_text(stmt, 1, key.toUtf8().constData(), -1, nullptr);
+    if (SQLITE_OK != inspectPlan(stmt)) {
+        sqlite3_finalize(stmt);
+        unlockForWrite();
+        qWarning() << "checkTableKeyIsExist --> " << planError();
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, key.toUtf8().constData(), -1, SQLITE_TRANSIENT);
     const int rc = sqlite3_step(stmt);
+    recordPlanStatus(stmt);
     sqlite3_finalize(stmt);
     unlockForWrite();
 
     return (rc == SQLITE_ROW);
 }
 
+int sqlite3_wrap::Sqlite3Private::createModule(const QString & name, const sqlite3_module * module, void * clientData, void (*destroy)(void*))
+{
+    QMutexLocker locker(&mMutexLocker);
+    if (!mDB) {
+        // 与 sqlite3_create_module_v2() 失败时的行为一致
+        if (destroy) {
+            destroy(clientData);
+        }
+        return SQLITE_MISUSE;
+    }
+
+    return sqlite3_create_module_v2(mDB, name.toUtf8().constData(), module, clientData, destroy);
+}
+
 void sqlite3_wrap::Sqlite3Private::lockForWrite()
 {
+    touch();
+    if (mImmutable) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
     mMutexLocker.lock();
-    mLocker->lock();
+    if (!mHybrid) {
+        mLocker->lock();
+    }
+    const auto waitNs = static_cast<quint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+    ++mLockAcquisitions;
+    mLockWaitNs += waitNs;
+    quint64 maxWaitNs = mLockMaxWaitNs.load();
+    while (waitNs > maxWaitNs && !mLockMaxWaitNs.compare_exchange_weak(maxWaitNs, waitNs)) {
+    }
 }
 
 void sqlite3_wrap::Sqlite3Private::unlockForWrite()
 {
+    if (mImmutable) {
+        return;
+    }
+    // QLockFile 不是线程安全的, 必须在释放线程锁之前解除进程锁
+    if (!mHybrid) {
+        mLocker->unlock();
+    }
     mMutexLocker.unlock();
+}
+
+sqlite3_wrap::Sqlite3LockStatistics sqlite3_wrap::Sqlite3Private::lockStatistics() const
+{
+    Sqlite3LockStatistics stat;
+    stat.acquisitions = mLockAcquisitions.load();
+    stat.waitNs = mLockWaitNs.load();
+    stat.maxWaitNs = mLockMaxWaitNs.load();
+
+    return stat;
+}
+
+void sqlite3_wrap::Sqlite3Private::resetLockStatistics()
+{
+    mLockAcquisitions = 0;
+    mLockWaitNs = 0;
+    mLockMaxWaitNs = 0;
+}
+
+std::shared_ptr<sqlite3_wrap::Sqlite3ChangeFeed> sqlite3_wrap::Sqlite3Private::subscribeChanges(int capacity, bool withValues)
+{
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+    if (withValues) {
+        qWarning() << "subscribeChanges --> column values require SQLite built with SQLITE_ENABLE_PREUPDATE_HOOK";
+        return nullptr;
+    }
+#endif
+    const auto feed = std::make_shared<Sqlite3ChangeFeed>(capacity);
+
+    QMutexLocker locker(&mMutexLocker);
+    {
+        // 不能在持有 mFeedLocker 时调用 sqlite3_*_hook, commit hook 内部会反向加锁
+        QMutexLocker feedLocker(&mFeedLocker);
+        mFeeds.push_back(feed);
+        if (withValues) {
+            mFeedValues = true;
+        }
+    }
+    installChangeHooks(true);
+
+    return feed;
+}
+
+void sqlite3_wrap::Sqlite3Private::unsubscribeChanges(const std::shared_ptr<Sqlite3ChangeFeed>& feed)
+{
+    QMutexLocker locker(&mMutexLocker);
+    bool hasFeeds = false;
+    {
+        QMutexLocker feedLocker(&mFeedLocker);
+        mFeeds.erase(std::remove(mFeeds.begin(), mFeeds.end(), feed), mFeeds.end());
+        hasFeeds = !mFeeds.empty();
+        if (!hasFeeds) {
+            mFeedValues = false;
+        }
+    }
+    installChangeHooks(hasFeeds);
+}
+
+void sqlite3_wrap::Sqlite3Private::setPlanCheck(Sqlite3QueryPlan::Check check)
+{
+    mPlanCheck = check;
+    clearPlanError();
+}
+
+void sqlite3_wrap::Sqlite3Private::markHot(const QString & sql)
+{
+    const QString key = normalizeSql(sql.toUtf8().constData());
+
+    QMutexLocker locker(&mPlanLocker);
+    if (!mHotSql.contains(key)) {
+        mHotSql.append(key);
+    }
+    if (mPlans.contains(key)) {
+        mPlans[key].hot = true;
+    }
+}
+
+QList<sqlite3_wrap::Sqlite3QueryPlan> sqlite3_wrap::Sqlite3Private::queryPlans() const
+{
+    QMutexLocker locker(&mPlanLocker);
+
+    return mPlans.values();
+}
+
+void sqlite3_wrap::Sqlite3Private::resetQueryPlans()
+{
+    QMutexLocker locker(&mPlanLocker);
+    mPlans.clear();
+    mPlanError.clear();
+}
+
+int sqlite3_wrap::Sqlite3Private::inspectPlan(sqlite3_stmt * stmt)
+{
+    const int check = mPlanCheck.load();
+    if (Sqlite3QueryPlan::Off == check || !stmt || sqlite3_stmt_isexplain(stmt)) {
+        return SQLITE_OK;
+    }
+
+    const QString key = normalizeSql(sqlite3_sql(stmt));
+
+    QMutexLocker locker(&mPlanLocker);
+    if (!mPlans.contains(key)) {
+        Sqlite3QueryPlan plan;
+        plan.sql = key;
+        plan.hot = mHotSql.contains(key);
+        capturePlan(plan);
+        mPlans[key] = plan;
+    }
+
+    Sqlite3QueryPlan& plan = mPlans[key];
+    ++plan.prepares;
+    if (!plan.hot || plan.fullScans.isEmpty() || Sqlite3QueryPlan::Capture == check) {
+        return SQLITE_OK;
+    }
+
+    const QString error = QString("full table scan in hot statement '%1': %2").arg(key).arg(plan.fullScans.join("; "));
+    if (Sqlite3QueryPlan::Warn == check) {
+        qWarning() << error;
+        return SQLITE_OK;
+    }
+    mPlanError = error;
+
+    return SQLITE_ERROR;
+}
+
+void sqlite3_wrap::Sqlite3Private::recordPlanStatus(sqlite3_stmt * stmt)
+{
+    if (Sqlite3QueryPlan::Off == mPlanCheck.load() || !stmt || sqlite3_stmt_isexplain(stmt)) {
+        return;
+    }
+
+    const QString key = normalizeSql(sqlite3_sql(stmt));
+    const auto fullScanSteps = static_cast<quint64>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0));
+    const auto sorts = static_cast<quint64>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0));
+    const auto vmSteps = static_cast<quint64>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0));
+
+    QMutexLocker locker(&mPlanLocker);
+    if (!mPlans.contains(key)) {
+        return;
+    }
+    Sqlite3QueryPlan& plan = mPlans[key];
+    plan.fullScanSteps += fullScanSteps;
+    plan.sorts += sorts;
+    plan.vmSteps += vmSteps;
+}
+
+QString sqlite3_wrap::Sqlite3Private::planError() const
+{
+    QMutexLocker locker(&mPlanLocker);
+
+    return mPlanError;
+}
+
+void sqlite3_wrap::Sqlite3Private::clearPlanError()
+{
+    QMutexLocker locker(&mPlanLocker);
+    mPlanError.clear();
+}
+
+void sqlite3_wrap::Sqlite3Private::capturePlan(Sqlite3QueryPlan & plan)
+{
+    sqlite3_stmt* stmt = nullptr;
+    const QByteArray sql = QString("EXPLAIN QUERY PLAN %1").arg(plan.sql).toUtf8();
+    if (SQLITE_OK != sqlite3_prepare_v2(mDB, sql.constData(), sql.size(), &stmt, nullptr)) {
+        qWarning() << "capturePlan --> sqlite3_prepare_v2() failed: " << sqlite3_errmsg(mDB);
+        return;
+    }
+
+    // 列: id, parent, notused, detail
+    while (SQLITE_ROW == sqlite3_step(stmt)) {
+        const QString detail = QString::fromUtf8(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3)));
+        plan.steps.append(detail);
+        if (isFullScan(detail)) {
+            plan.fullScans.append(detail);
+        }
+        if (detail.contains("USE TEMP B-TREE")) {
+            plan.tempBTree = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+}
+
+void sqlite3_wrap::Sqlite3Private::registerFunctions()
+{
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+    sqlite3_create_function_v2(mDB, "wrap_decompress", 1, flags, nullptr, decompressFunction, nullptr, nullptr, nullptr);
+    sqlite3_create_function_v2(mDB, "wrap_compress", 1, flags, nullptr, compressFunction, nullptr, nullptr, nullptr);
+    sqlite3_create_function_v2(mDB, "wrap_compress", 2, flags, nullptr, compressFunction, nullptr, nullptr, nullptr);
+}
+
+void sqlite3_wrap::Sqlite3Private::installChangeHooks(bool enable)
+{
+    if (!mDB) {
+        return;
+    }
+
+    // 持有连接互斥锁, 保证替换 hook 与清空未提交变更对 hook 回调是原子的
+    sqlite3_mutex* mutex = sqlite3_db_mutex(mDB);
+    sqlite3_mutex_enter(mutex);
+    mPendingChanges.clear();
+    mCommittingChanges.clear();
+    mSavepoints.clear();
+    mTrackChanges = enable;
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+    sqlite3_preupdate_hook(mDB, enable ? &Sqlite3Private::preupdateHook : nullptr, this);
+#else
+    sqlite3_update_hook(mDB, enable ? &Sqlite3Private::updateHook : nullptr, this);
+#endif
+    sqlite3_commit_hook(mDB, enable ? &Sqlite3Private::commitHook : nullptr, this);
+    sqlite3_rollback_hook(mDB, enable ? &Sqlite3Private::rollbackHook : nullptr, this);
+    sqlite3_mutex_leave(mutex);
+}
+
+void sqlite3_wrap::Sqlite3Private::publishChanges()
+{
+    if (mCommittingChanges.empty()) {
+        return;
+    }
+
+    QMutexLocker feedLocker(&mFeedLocker);
+    for (size_t i = 0; i < mFeeds.size(); ++i) {
+        const bool last = (i + 1 == mFeeds.size());
+        for (auto& change : mCommittingChanges) {
+            if (last) {
+                mFeeds[i]->publish(change);
+            }
+            else {
+                Sqlite3Change copy = change;
+                mFeeds[i]->publish(copy);
+            }
+        }
+        mFeeds[i]->notify();
+    }
+    mCommittingChanges.clear();
+}
+
+void sqlite3_wrap::Sqlite3Private::trackSavepoint(const char* sql)
+{
+    // 只识别 SAVEPOINT name / RELEASE [SAVEPOINT] name / ROLLBACK [TRANSACTION] TO [SAVEPOINT] name
+    QStringList words = QString::fromUtf8(sql ? sql : "").simplified().remove(';').split(' ');
+    if (words.isEmpty()) {
+        return;
+    }
+
+    const QString verb = words.takeFirst().toUpper();
+    if ("ROLLBACK" == verb && !words.isEmpty() && "TRANSACTION" == words.first().toUpper()) {
+        words.removeFirst();
+    }
+    if ("ROLLBACK" == verb) {
+        if (words.isEmpty() || "TO" != words.first().toUpper()) {
+            return;                                             // 整个事务回滚由 rollback hook 处理
+        }
+        words.removeFirst();
+    }
+    if (("RELEASE" == verb || "ROLLBACK" == verb) && words.size() > 1 && "SAVEPOINT" == words.first().toUpper()) {
+        words.removeFirst();
+    }
+    if (words.isEmpty()) {
+        return;
+    }
+
+    QString name = words.first();
+    if (name.size() > 1 && (name.startsWith('"') || name.startsWith('`') || name.startsWith('[') || name.startsWith('\''))) {
+        name = name.mid(1, name.size() - 2);
+    }
+
+    if ("SAVEPOINT" == verb) {
+        mSavepoints.push_back(std::make_pair(name, mPendingChanges.size()));
+        return;
+    }
+    if ("RELEASE" != verb && "ROLLBACK" != verb) {
+        return;
+    }
+
+    // savepoint 名称不区分大小写, 同名时取最内层
+    auto it = mSavepoints.end();
+    while (it != mSavepoints.begin()) {
+        --it;
+        if (0 == it->first.compare(name, Qt::CaseInsensitive)) {
+            if ("ROLLBACK" == verb) {
+                if (mPendingChanges.size() > it->second) {
+                    mPendingChanges.erase(mPendingChanges.begin() + it->second, mPendingChanges.end());
+                }
+                mSavepoints.erase(it + 1, mSavepoints.end());   // ROLLBACK TO 之后该 savepoint 仍然有效
+            }
+            else {
+                mSavepoints.erase(it, mSavepoints.end());
+            }
+            return;
+        }
+    }
+}
+
+void sqlite3_wrap::Sqlite3Private::updateHook(void * data, int op, const char * database, const char * table, sqlite3_int64 rowid)
+{
+    Sqlite3Change change;
+    change.op = static_cast<Sqlite3Change::Operation>(op);
+    change.database = database;
+    change.table = table;
+    change.rowid = rowid;
+    change.newRowid = rowid;
+
+    static_cast<Sqlite3Private*>(data)->mPendingChanges.push_back(std::move(change));
+}
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+void sqlite3_wrap::Sqlite3Private::preupdateHook(void * data, sqlite3 * db, int op, const char * database, const char * table, sqlite3_int64 rowid, sqlite3_int64 newRowid)
+{
+    const auto d = static_cast<Sqlite3Private*>(data);
+    if (0 == ::strncmp(table, "sqlite_", 7)) {
+        return;
+    }
+
+    Sqlite3Change change;
+    change.op = static_cast<Sqlite3Change::Operation>(op);
+    change.database = database;
+    change.table = table;
+    change.rowid = (SQLITE_INSERT == op) ? newRowid : rowid;
+    change.newRowid = (SQLITE_DELETE == op) ? rowid : newRowid;
+    if (d->mFeedValues) {
+        const int count = sqlite3_preupdate_count(db);
+        for (int i = 0; i < count; ++i) {
+            sqlite3_value* value = nullptr;
+            if (SQLITE_INSERT != op && SQLITE_OK == sqlite3_preupdate_old(db, i, &value)) {
+                change.oldValues.append(toVariant(value));
+            }
+            if (SQLITE_DELETE != op && SQLITE_OK == sqlite3_preupdate_new(db, i, &value)) {
+                change.newValues.append(toVariant(value));
+            }
+        }
+    }
+
+    d->mPendingChanges.push_back(std::move(change));
+}
+#endif
+
+int sqlite3_wrap::Sqlite3Private::commitHook(void * data)
+{
+    // 此时提交仍可能失败 (例如 SQLITE_BUSY), 先挪到待确认区, 由 step() 在提交完成后投递
+    const auto d = static_cast<Sqlite3Private*>(data);
+    std::move(d->mPendingChanges.begin(), d->mPendingChanges.end(), std::back_inserter(d->mCommittingChanges));
+    d->mPendingChanges.clear();
+    d->mSavepoints.clear();
+
+    // 返回非 0 会把提交变成回滚
+    return 0;
+}
+
+void sqlite3_wrap::Sqlite3Private::rollbackHook(void * data)
+{
+    const auto d = static_cast<Sqlite3Private*>(data);
+    d->mRolledBack = true;
+    d->mPendingChanges.clear();
+    d->mCommittingChanges.clear();
+    d->mSavepoints.clear();
+}
+
+int sqlite3_wrap::Sqlite3Private::startMaintenance(const Sqlite3MaintenanceOptions & options)
+{
+    stopMaintenance();
+
+    QMutexLocker locker(&mMutexLocker);
+    if (!mDB) {
+        return SQLITE_MISUSE;
+    }
+    if (mImmutable) {
+        return SQLITE_READONLY;
+    }
+    if (mHybrid) {
+        return SQLITE_MISUSE;
+    }
+
+    sqlite3* db = nullptr;
+    const int rc = sqlite3_open_v2(mDBName.toUtf8().constData(), &db, SQLITE_OPEN_READWRITE, nullptr);
+    if (SQLITE_OK != rc) {
+        qWarning() << "startMaintenance --> sqlite3_open_v2() failed: " << sqlite3_errmsg(db);
+        sqlite3_close(db);
+        return rc;
+    }
+    sqlite3_busy_timeout(db, options.taskBudgetMs);
+    // 新连接读过一次库之后才进入 WAL 模式, 否则第一次 checkpoint 返回 -1 帧
+    queryInt(db, "PRAGMA schema_version;");
+
+    {
+        QMutexLocker maintenanceLocker(&mMaintenanceLocker);
+        mMaintenanceOptions = options;
+        mMaintenanceStop = false;
+    }
+    mLastActivityMs = steadyMs();
+    mMaintenanceRunning = true;
+    mMaintenanceThread = std::thread(&Sqlite3Private::maintenanceLoop, this, db);
+
+    return SQLITE_OK;
+}
+
+void sqlite3_wrap::Sqlite3Private::stopMaintenance()
+{
+    {
+        QMutexLocker locker(&mMaintenanceLocker);
+        mMaintenanceStop = true;
+        mMaintenanceCondition.wakeAll();
+    }
+    if (mMaintenanceThread.joinable()) {
+        mMaintenanceThread.join();
+    }
+    mMaintenanceRunning = false;
+}
+
+void sqlite3_wrap::Sqlite3Private::lockForMaintenance()
+{
+    mMutexLocker.lock();
+    mLocker->lock();
+}
+
+void sqlite3_wrap::Sqlite3Private::unlockForMaintenance()
+{
     mLocker->unlock();
+    mMutexLocker.unlock();
+}
+
+sqlite3_wrap::Sqlite3MaintenanceStatistics sqlite3_wrap::Sqlite3Private::maintenanceStatistics() const
+{
+    QMutexLocker locker(&mMaintenanceLocker);
+
+    return mMaintenanceStatistics;
+}
+
+void sqlite3_wrap::Sqlite3Private::touch()
+{
+    // 每一行 step 都会调用, 没有维护线程时只付出一次 relaxed 读
+    if (mMaintenanceRunning.load(std::memory_order_relaxed)) {
+        mLastActivityMs.store(steadyMs(), std::memory_order_relaxed);
+    }
+}
+
+bool sqlite3_wrap::Sqlite3Private::isIdle(const Sqlite3MaintenanceOptions & options) const
+{
+    return steadyMs() - mLastActivityMs.load() >= options.idleMs;
+}
+
+void sqlite3_wrap::Sqlite3Private::maintenanceLoop(sqlite3 * db)
+{
+    auto lastOptimize = std::chrono::steady_clock::time_point();
+
+    QMutexLocker locker(&mMaintenanceLocker);
+    while (!mMaintenanceStop) {
+        mMaintenanceCondition.wait(&mMaintenanceLocker, static_cast<unsigned long>(qMax(mMaintenanceOptions.intervalMs, 1)));
+        if (mMaintenanceStop) {
+            break;
+        }
+        const Sqlite3MaintenanceOptions options = mMaintenanceOptions;
+        locker.unlock();
+
+        if (isIdle(options)) {
+            runCheckpoint(db, options);
+        }
+        if (isIdle(options)) {
+            runVacuum(db, options);
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (options.optimizeIntervalMs > 0 && isIdle(options)
+            && (lastOptimize == std::chrono::steady_clock::time_point() || now - lastOptimize >= std::chrono::milliseconds(options.optimizeIntervalMs))) {
+            runOptimize(db, options);
+            lastOptimize = now;
+        }
+
+        locker.relock();
+    }
+    locker.unlock();
+
+    sqlite3_close(db);
+}
+
+void sqlite3_wrap::Sqlite3Private::runCheckpoint(sqlite3 * db, const Sqlite3MaintenanceOptions & options)
+{
+    const qint64 walBytes = QFileInfo(mDBName + "-wal").size();
+    int mode = SQLITE_CHECKPOINT_PASSIVE;
+    if (options.walTruncateBytes > 0 && walBytes >= options.walTruncateBytes) {
+        mode = SQLITE_CHECKPOINT_TRUNCATE;
+    }
+    else if (options.walPassiveBytes <= 0 || walBytes < options.walPassiveBytes) {
+        return;
+    }
+
+    // PASSIVE 不阻塞写者, 无需持有写锁; TRUNCATE 需要等待写者, 与 execute() 互斥
+    const auto start = std::chrono::steady_clock::now();
+    int frames = 0;
+    int checkpointed = 0;
+    int rc = SQLITE_OK;
+    if (SQLITE_CHECKPOINT_TRUNCATE == mode) {
+        // TRUNCATE 截断之后把帧数清零, 先用不阻塞写者的 PASSIVE 拷贝并统计, 再截断
+        sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &frames, &checkpointed);
+        lockForMaintenance();
+        int truncated = 0;
+        rc = sqlite3_wal_checkpoint_v2(db, nullptr, mode, &frames, &truncated);
+        unlockForMaintenance();
+        checkpointed += truncated;
+    }
+    else {
+        rc = sqlite3_wal_checkpoint_v2(db, nullptr, mode, &frames, &checkpointed);
+    }
+
+    recordTask(&Sqlite3MaintenanceStatistics::checkpoint, start, rc);
+    if (checkpointed > 0) {
+        QMutexLocker locker(&mMaintenanceLocker);
+        mMaintenanceStatistics.checkpointedFrames += static_cast<quint64>(checkpointed);
+    }
+}
+
+void sqlite3_wrap::Sqlite3Private::runVacuum(sqlite3 * db, const Sqlite3MaintenanceOptions & options)
+{
+    if (options.vacuumPages <= 0) {
+        return;
+    }
+    // 只有 auto_vacuum = INCREMENTAL 时 incremental_vacuum 才有效
+    if (2 != queryInt(db, "PRAGMA auto_vacuum;")) {
+        return;
+    }
+    const int before = queryInt(db, "PRAGMA freelist_count;");
+    if (before <= 0) {
+        return;
+    }
+
+    // 分批执行, 批次之间释放写锁, 让等待的写者插入
+    const auto start = std::chrono::steady_clock::now();
+    const auto deadline = start + std::chrono::milliseconds(options.taskBudgetMs);
+    const QByteArray sql = QString("PRAGMA incremental_vacuum(%1);").arg(options.vacuumPages).toUtf8();
+    int rc = SQLITE_OK;
+    int remaining = before;
+    while (SQLITE_OK == rc && remaining > 0 && std::chrono::steady_clock::now() < deadline && isIdle(options)) {
+        lockForMaintenance();
+        rc = sqlite3_exec(db, sql.constData(), nullptr, nullptr, nullptr);
+        unlockForMaintenance();
+        remaining = queryInt(db, "PRAGMA freelist_count;");
+    }
+
+    recordTask(&Sqlite3MaintenanceStatistics::vacuum, start, rc);
+    if (remaining < before) {
+        QMutexLocker locker(&mMaintenanceLocker);
+        mMaintenanceStatistics.vacuumedPages += static_cast<quint64>(before - qMax(remaining, 0));
+    }
+}
+
+void sqlite3_wrap::Sqlite3Private::runOptimize(sqlite3 * db, const Sqlite3MaintenanceOptions & options)
+{
+    const auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(options.taskBudgetMs);
+    const QByteArray sql = QString("PRAGMA optimize = 0x%1;").arg(options.optimizeMask, 0, 16).toUtf8();
+
+    lockForMaintenance();
+    sqlite3_progress_handler(db, 1000, &Sqlite3Private::progressHandler, &deadline);
+    const int rc = sqlite3_exec(db, sql.constData(), nullptr, nullptr, nullptr);
+    sqlite3_progress_handler(db, 0, nullptr, nullptr);
+    unlockForMaintenance();
+
+    recordTask(&Sqlite3MaintenanceStatistics::optimize, start, rc);
+}
+
+void sqlite3_wrap::Sqlite3Private::recordTask(Sqlite3MaintenanceTaskStatistics Sqlite3MaintenanceStatistics::* task, std::chrono::steady_clock::time_point start, int rc)
+{
+    const auto us = static_cast<quint64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+    QMutexLocker locker(&mMaintenanceLocker);
+    auto& stat = mMaintenanceStatistics.*task;
+    ++stat.runs;
+    stat.totalUs += us;
+    stat.lastUs = us;
+    stat.lastRc = rc;
+    if (SQLITE_INTERRUPT == (rc & 0xFF)) {
+        ++stat.interrupted;
+    }
+}
+
+int sqlite3_wrap::Sqlite3Private::progressHandler(void * data)
+{
+    const auto deadline = static_cast<const std::chrono::steady_clock::time_point*>(data);
+    return (std::chrono::steady_clock::now() >= *deadline) ? 1 : 0;
 }
 
 sqlite3_wrap::Sqlite3::Sqlite3(bool showSQL, QObject* parent)
@@ -182,73 +1428,197 @@ sqlite3_wrap::Sqlite3::Sqlite3(Sqlite3&& db) noexcept
 {
 }
 
-sqlite3_wrap::Sqlite3& sqlite3_wrap::Sqlite3::operator=(Sqlite3&& db) noexcept
+sqlite3_wrap::Sqlite3& sqlite3_wrap::Sqlite3::operator=(Sqlite3&& db) noexcept
+{
+    d_ptr = db.d_ptr;
+    return *this;
+}
+
+void sqlite3_wrap::Sqlite3::disconnect()
+{
+    Q_D(Sqlite3);
+
+    d->disconnect();
+}
+
+int sqlite3_wrap::Sqlite3::connect(const QString & dbName)
+{
+    Q_D(Sqlite3);
+
+    return d->connect(dbName);
+}
+
+int sqlite3_wrap::Sqlite3::connectImmutable(const QString & dbName, const Sqlite3ImmutableOptions & options)
+{
+    Q_D(Sqlite3);
+
+    return d->connectImmutable(dbName, options);
+}
+
+int sqlite3_wrap::Sqlite3::connectHybrid(const QString & dbName, const Sqlite3HybridOptions & options)
+{
+    Q_D(Sqlite3);
+
+    return d->connectHybrid(dbName, options);
+}
+
+int sqlite3_wrap::Sqlite3::flush()
+{
+    Q_D(Sqlite3);
+
+    return d->flush();
+}
+
+int sqlite3_wrap::Sqlite3::execute(char const * sql, ...)
+{
+    Q_D(Sqlite3);
+
+    va_list ap;
+    va_start(ap, sql);
+    const std::shared_ptr<char> msql(sqlite3_vmprintf(sql, ap), sqlite3_free);
+    va_end(ap);
+
+    return d->execute(msql.get());
+}
+
+int sqlite3_wrap::Sqlite3::errorCode() const
+{
+    Q_D(const Sqlite3);
+
+    return sqlite3_errcode(d->mDB);
+}
+
+bool sqlite3_wrap::Sqlite3::checkTableIsExist(const QString & tableName)
+{
+    Q_D(Sqlite3);
+
+    return d->checkTableIsExist(tableName);
+}
+
+bool sqlite3_wrap::Sqlite3::checkKeyExist(const QString & tableName, const QString & fieldName, qint64 key)
+{
+    Q_D(Sqlite3);
+
+    return d->checkTableKeyIsExist(tableName, fieldName, key);
+}
+
+bool sqlite3_wrap::Sqlite3::checkKeyExist(const QString & tableName, const QString& fieldName, const QString & key)
+{
+    Q_D(Sqlite3);
+
+    return d->checkTableKeyIsExist(tableName, fieldName, key);
+}
+
+int sqlite3_wrap::Sqlite3::createModule(const QString & name, const sqlite3_module * module, void * clientData, void (*destroy)(void*))
+{
+    Q_D(Sqlite3);
+
+    return d->createModule(name, module, clientData, destroy);
+}
+
+sqlite3_wrap::Sqlite3LockStatistics sqlite3_wrap::Sqlite3::lockStatistics() const
+{
+    Q_D(const Sqlite3);
+
+    return d->lockStatistics();
+}
+
+void sqlite3_wrap::Sqlite3::resetLockStatistics()
 {
-    d_ptr = db.d_ptr;
-    return *this;
+    Q_D(Sqlite3);
+
+    d->resetLockStatistics();
 }
 
-void sqlite3_wrap::Sqlite3::disconnect()
+std::shared_ptr<sqlite3_wrap::Sqlite3ChangeFeed> sqlite3_wrap::Sqlite3::subscribeChanges(int capacity, bool withValues)
 {
     Q_D(Sqlite3);
 
-    d->disconnect();
+    return d->subscribeChanges(capacity, withValues);
 }
 
-int sqlite3_wrap::Sqlite3::connect(const QString & dbName)
+void sqlite3_wrap::Sqlite3::unsubscribeChanges(const std::shared_ptr<Sqlite3ChangeFeed>& feed)
 {
     Q_D(Sqlite3);
 
-    return d->connect(dbName);
+    d->unsubscribeChanges(feed);
 }
 
-int sqlite3_wrap::Sqlite3::execute(char const * sql, ...)
+int sqlite3_wrap::Sqlite3::startMaintenance(const Sqlite3MaintenanceOptions & options)
 {
     Q_D(Sqlite3);
 
-    va_list ap;
-    va_start(ap, sql);
-    const std::shared_ptr<char> msql(sqlite3_vmprintf(sql, ap), sqlite3_free);
-    va_end(ap);
+    return d->startMaintenance(options);
+}
 
-    return d->execute(msql.get());
+void sqlite3_wrap::Sqlite3::stopMaintenance()
+{
+    Q_D(Sqlite3);
+
+    d->stopMaintenance();
 }
 
-int sqlite3_wrap::Sqlite3::errorCode() const
+sqlite3_wrap::Sqlite3MaintenanceStatistics sqlite3_wrap::Sqlite3::maintenanceStatistics() const
 {
     Q_D(const Sqlite3);
 
-    return sqlite3_errcode(d->mDB);
+    return d->maintenanceStatistics();
 }
 
-bool sqlite3_wrap::Sqlite3::checkTableIsExist(const QString & tableName)
+void sqlite3_wrap::Sqlite3::setPlanCheck(Sqlite3QueryPlan::Check check)
 {
     Q_D(Sqlite3);
 
-    return d->checkTableIsExist(tableName);
+    d->setPlanCheck(check);
 }
 
-bool sqlite3_wrap::Sqlite3::checkKeyExist(const QString & tableName, const QString & fieldName, qint64 key)
+void sqlite3_wrap::Sqlite3::markHot(const QString & sql)
 {
     Q_D(Sqlite3);
 
-    return d->checkTableKeyIsExist(tableName, fieldName, key);
+    d->markHot(sql);
 }
 
-bool sqlite3_wrap::Sqlite3::checkKeyExist(const QString & tableName, const QString& fieldName, const QString & key)
+QList<sqlite3_wrap::Sqlite3QueryPlan> sqlite3_wrap::Sqlite3::queryPlans() const
+{
+    Q_D(const Sqlite3);
+
+    return d->queryPlans();
+}
+
+void sqlite3_wrap::Sqlite3::resetQueryPlans()
 {
     Q_D(Sqlite3);
 
-    return d->checkTableKeyIsExist(tableName, fieldName, key);
+    d->resetQueryPlans();
 }
 
 QString sqlite3_wrap::Sqlite3::lastError() const
 {
     Q_D(const Sqlite3);
 
+    // 计划检查失败时 SQLite 本身没有错误
+    if (SQLITE_OK == sqlite3_errcode(d->mDB)) {
+        const QString error = d->planError();
+        if (!error.isEmpty()) {
+            return error;
+        }
+    }
+
     return sqlite3_errmsg(d->mDB);
 }
 
+sqlite3_wrap::Sqlite3WriteLocker::Sqlite3WriteLocker(Sqlite3 & db)
+    : mDB(db)
+{
+    mDB.d_ptr->lockForWrite();
+}
+
+sqlite3_wrap::Sqlite3WriteLocker::~Sqlite3WriteLocker()
+{
+    mDB.d_ptr->unlockForWrite();
+}
+
 int sqlite3_wrap::Sqlite3Statement::prepare(const QString& stmt)
 {
     const auto rc = finish();
@@ -263,6 +1633,7 @@ int sqlite3_wrap::Sqlite3Statement::finish()
 {
     auto rc = SQLITE_OK;
     if (mStmt) {
+        mDB.d_ptr->recordPlanStatus(mStmt);
         rc = finish_impl(mStmt);
         mStmt = nullptr;
     }
@@ -326,9 +1697,74 @@ int sqlite3_wrap::Sqlite3Statement::bind(const QString & name, const QString & v
     return bind(idx, value);
 }
 
+int sqlite3_wrap::Sqlite3Statement::bindBlob(int idx, const QByteArray & value) const
+{
+    return sqlite3_bind_blob(mStmt, idx, value.constData(), value.size(), SQLITE_TRANSIENT);
+}
+
+int sqlite3_wrap::Sqlite3Statement::bindBlob(const QString & name, const QByteArray & value) const
+{
+    const auto idx = sqlite3_bind_parameter_index(mStmt, name.toUtf8().constData());
+    return bindBlob(idx, value);
+}
+
+int sqlite3_wrap::Sqlite3Statement::bindCompressed(int idx, const QString & value, const Sqlite3Codec & codec) const
+{
+    const QByteArray raw = value.toUtf8();
+
+    static thread_local std::vector<unsigned char> buffer;
+    if (raw.size() >= codec.threshold && compressValue(raw.constData(), raw.size(), codec.level, buffer)
+        && buffer.size() < static_cast<size_t>(raw.size())) {
+        return sqlite3_bind_blob(mStmt, idx, buffer.data(), static_cast<int>(buffer.size()), SQLITE_TRANSIENT);
+    }
+
+    return sqlite3_bind_text(mStmt, idx, raw.constData(), raw.size(), SQLITE_TRANSIENT);
+}
+
+int sqlite3_wrap::Sqlite3Statement::bindCompressed(const QString & name, const QString & value, const Sqlite3Codec & codec) const
+{
+    const auto idx = sqlite3_bind_parameter_index(mStmt, name.toUtf8().constData());
+    return bindCompressed(idx, value, codec);
+}
+
+int sqlite3_wrap::Sqlite3Statement::bindValue(int idx, const QVariant & value) const
+{
+    if (!value.isValid()) {
+        return bind(idx);
+    }
+
+    switch (value.type()) {
+        case QVariant::Bool:
+        case QVariant::Int: {
+            return bind(idx, value.toInt());
+        }
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong: {
+            return bind(idx, static_cast<long long int>(value.toLongLong()));
+        }
+        case QVariant::Double: {
+            return bind(idx, value.toDouble());
+        }
+        case QVariant::ByteArray: {
+            return bindBlob(idx, value.toByteArray());
+        }
+        default: {
+            return bind(idx, value.toString());
+        }
+    }
+}
+
+int sqlite3_wrap::Sqlite3Statement::bindValue(const QString & name, const QVariant & value) const
+{
+    const auto idx = sqlite3_bind_parameter_index(mStmt, name.toUtf8().constData());
+    return bindValue(idx, value);
+}
+
 int sqlite3_wrap::Sqlite3Statement::step() const
 {
-    return sqlite3_step(mStmt);
+    mDB.d_ptr->touch();
+    return mDB.d_ptr->step(mStmt);
 }
 
 int sqlite3_wrap::Sqlite3Statement::reset() const
@@ -354,7 +1790,17 @@ sqlite3_wrap::Sqlite3Statement::~Sqlite3Statement()
 
 int sqlite3_wrap::Sqlite3Statement::prepare_impl(const QString& stmt)
 {
-    return sqlite3_prepare_v2(mDB.d_ptr->mDB, stmt.toUtf8().constData(), stmt.length(), &mStmt, &mTail);
+    // mTail 指向 mSql 内部, 供 executeAll() 继续执行后续语句
+    mSql = stmt.toUtf8();
+    mDB.d_ptr->clearPlanError();
+    int rc = sqlite3_prepare_v2(mDB.d_ptr->mDB, mSql.constData(), mSql.size(), &mStmt, &mTail);
+    if (SQLITE_OK == rc && SQLITE_OK != (rc = mDB.d_ptr->inspectPlan(mStmt))) {
+        finish_impl(mStmt);
+        mStmt = nullptr;
+        mTail = nullptr;
+    }
+
+    return rc;
 }
 
 int sqlite3_wrap::Sqlite3Statement::finish_impl(sqlite3_stmt * stmt)
@@ -466,6 +1912,21 @@ char const * sqlite3_wrap::Sqlite3Query::Rows::get(int idx, char const *) const
     return reinterpret_cast<char const*>(sqlite3_column_text(mStmt, idx));
 }
 
+QString sqlite3_wrap::Sqlite3Query::Rows::getDecompressed(int idx) const
+{
+    if (SQLITE_BLOB != sqlite3_column_type(mStmt, idx)) {
+        return get(idx, QString());
+    }
+
+    static thread_local std::vector<char> buffer;
+    if (!decompressValue(sqlite3_column_blob(mStmt, idx), sqlite3_column_bytes(mStmt, idx), buffer)) {
+        qWarning() << "getDecompressed --> corrupt compressed value in column " << idx;
+        return QString();
+    }
+
+    return QString::fromUtf8(buffer.data(), static_cast<int>(buffer.size()));
+}
+
 QString sqlite3_wrap::Sqlite3Query::Rows::get(int idx, QString) const
 {
     return get(idx, static_cast<char const*>(nullptr));
@@ -476,6 +1937,34 @@ void const * sqlite3_wrap::Sqlite3Query::Rows::get(int idx, void const *) const
     return sqlite3_column_blob(mStmt, idx);
 }
 
+QByteArray sqlite3_wrap::Sqlite3Query::Rows::get(int idx, QByteArray) const
+{
+    const auto blob = static_cast<const char*>(sqlite3_column_blob(mStmt, idx));
+    return QByteArray(blob, sqlite3_column_bytes(mStmt, idx));
+}
+
+QVariant sqlite3_wrap::Sqlite3Query::Rows::get(int idx, QVariant) const
+{
+    switch (sqlite3_column_type(mStmt, idx)) {
+        case SQLITE_INTEGER: {
+            return QVariant(get(idx, static_cast<long long int>(0)));
+        }
+        case SQLITE_FLOAT: {
+            return QVariant(get(idx, 0.0));
+        }
+        case SQLITE_TEXT: {
+            const auto text = reinterpret_cast<const char*>(sqlite3_column_text(mStmt, idx));
+            return QVariant(QString::fromUtf8(text, sqlite3_column_bytes(mStmt, idx)));
+        }
+        case SQLITE_BLOB: {
+            return QVariant(get(idx, QByteArray()));
+        }
+        default: {
+            return QVariant();
+        }
+    }
+}
+
 sqlite3_wrap::Sqlite3Query::Sqlite3QueryIterator::Sqlite3QueryIterator()
     : mCmd(nullptr), mRc(SQLITE_DONE)
 {
@@ -545,6 +2034,302 @@ sqlite3_wrap::Sqlite3Query::iterator sqlite3_wrap::Sqlite3Query::end() const
     return Sqlite3QueryIterator();
 }
 
+int sqlite3_wrap::Sqlite3Cursor::Page::rowCount() const
+{
+    return mRows;
+}
+
+int sqlite3_wrap::Sqlite3Cursor::Page::columnCount() const
+{
+    return mColumns;
+}
+
+const QVariant & sqlite3_wrap::Sqlite3Cursor::Page::value(int row, int column) const
+{
+    return mValues.at(static_cast<size_t>(row * mColumns + column));
+}
+
+sqlite3_wrap::Sqlite3Cursor::Sqlite3Cursor(Sqlite3 & db, const QString & query, const QStringList & keyColumns, int pageSize, bool descending)
+    : mDB(db),
+      mFirstPage(db, cursorSql(query, keyColumns, descending, false)),
+      mNextPage(db, cursorSql(query, keyColumns, descending, true)),
+      mPageSize(qMax(pageSize, 1))
+{
+    for (const auto& key : keyColumns) {
+        int idx = -1;
+        for (int i = 0; i < mFirstPage.columnCount(); ++i) {
+            if (mFirstPage.columnName(i) == key) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx < 0) {
+            throw std::runtime_error(QString("key column '%1' is not in the result").arg(key).toStdString());
+        }
+        mKeyIndexes.push_back(idx);
+    }
+}
+
+int sqlite3_wrap::Sqlite3Cursor::bindValue(int idx, const QVariant & value)
+{
+    while (mBinds.size() < idx) {
+        mBinds.append(QVariant());
+    }
+    mBinds[idx - 1] = value;
+
+    return SQLITE_OK;
+}
+
+bool sqlite3_wrap::Sqlite3Cursor::fetch(Page & page)
+{
+    page.mRows = 0;
+    page.mColumns = 0;
+    if (mAtEnd) {
+        return false;
+    }
+
+    Sqlite3Query& query = mLastKey.isEmpty() ? mFirstPage : mNextPage;
+    query.reset();
+    for (int i = 0; i < mBinds.size(); ++i) {
+        const int rc = query.bindValue(i + 1, mBinds.at(i));
+        if (SQLITE_OK != rc) {
+            throw std::runtime_error(mDB.lastError().toStdString());
+        }
+    }
+    if (SQLITE_OK != bindKeys(query) || SQLITE_OK != query.bind(":cursor_limit", mPageSize)) {
+        throw std::runtime_error(mDB.lastError().toStdString());
+    }
+
+    const int columns = query.columnCount();
+    size_t n = 0;
+    page.mColumns = columns;
+    for (auto row : query) {
+        for (int i = 0; i < columns; ++i, ++n) {
+            if (n < page.mValues.size()) {
+                page.mValues[n] = row.get<QVariant>(i);
+            }
+            else {
+                page.mValues.push_back(row.get<QVariant>(i));
+            }
+        }
+        ++page.mRows;
+    }
+    query.reset();
+
+    if (page.mRows > 0) {
+        const size_t last = static_cast<size_t>((page.mRows - 1) * columns);
+        mLastKey.clear();
+        for (const int idx : mKeyIndexes) {
+            mLastKey.append(page.mValues[last + static_cast<size_t>(idx)]);
+        }
+    }
+    mAtEnd = (page.mRows < mPageSize);
+
+    return page.mRows > 0;
+}
+
+bool sqlite3_wrap::Sqlite3Cursor::atEnd() const
+{
+    return mAtEnd;
+}
+
+void sqlite3_wrap::Sqlite3Cursor::rewind()
+{
+    mLastKey.clear();
+    mAtEnd = false;
+}
+
+QByteArray sqlite3_wrap::Sqlite3Cursor::resumeToken() const
+{
+    QByteArray token;
+    QDataStream stream(&token, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << static_cast<quint8>(1) << static_cast<quint8>(mAtEnd) << mLastKey;
+
+    return token.toBase64(QByteArray::Base64UrlEncoding);
+}
+
+bool sqlite3_wrap::Sqlite3Cursor::resume(const QByteArray & token)
+{
+    const QByteArray data = QByteArray::fromBase64(token, QByteArray::Base64UrlEncoding);
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint8 version = 0;
+    quint8 atEnd = 0;
+    QVariantList key;
+    stream >> version >> atEnd >> key;
+    if (QDataStream::Ok != stream.status() || 1 != version
+        || (!key.isEmpty() && key.size() != static_cast<int>(mKeyIndexes.size()))) {
+        return false;
+    }
+    mLastKey = key;
+    mAtEnd = (0 != atEnd);
+
+    return true;
+}
+
+int sqlite3_wrap::Sqlite3Cursor::bindKeys(Sqlite3Query & query) const
+{
+    for (int i = 0; i < mLastKey.size(); ++i) {
+        const int rc = query.bindValue(QString(":cursor_k%1").arg(i), mLastKey.at(i));
+        if (SQLITE_OK != rc) {
+            return rc;
+        }
+    }
+
+    return SQLITE_OK;
+}
+
+int sqlite3_wrap::Sqlite3ReadAhead::Row::columnCount() const
+{
+    return mColumns;
+}
+
+const QVariant & sqlite3_wrap::Sqlite3ReadAhead::Row::value(int idx) const
+{
+    return mValues[idx];
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::Iterator::Iterator()
+    : mReadAhead(nullptr)
+{
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::Iterator::Iterator(Sqlite3ReadAhead & readAhead)
+    : mReadAhead(&readAhead)
+{
+    if (!mReadAhead->next()) {
+        mReadAhead = nullptr;
+    }
+}
+
+bool sqlite3_wrap::Sqlite3ReadAhead::Iterator::operator==(Iterator const & other) const
+{
+    return mReadAhead == other.mReadAhead;
+}
+
+bool sqlite3_wrap::Sqlite3ReadAhead::Iterator::operator!=(Iterator const & other) const
+{
+    return mReadAhead != other.mReadAhead;
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::Iterator & sqlite3_wrap::Sqlite3ReadAhead::Iterator::operator++()
+{
+    if (!mReadAhead->next()) {
+        mReadAhead = nullptr;
+    }
+    return *this;
+}
+
+const sqlite3_wrap::Sqlite3ReadAhead::Row & sqlite3_wrap::Sqlite3ReadAhead::Iterator::operator*() const
+{
+    return mReadAhead->mRow;
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::Sqlite3ReadAhead(Sqlite3Query & query, int batchRows, int depth)
+    : mQuery(query), mColumns(query.columnCount()), mBatchRows(qMax(batchRows, 1)),
+      mBatches(static_cast<size_t>(qMax(depth, 1))), mHead(0), mTail(0), mStop(false)
+{
+    for (auto& batch : mBatches) {
+        batch.values.resize(static_cast<size_t>(mBatchRows * mColumns));
+    }
+    mRow.mColumns = mColumns;
+    mProducer = std::thread(&Sqlite3ReadAhead::produce, this);
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::~Sqlite3ReadAhead()
+{
+    mStop = true;
+    if (mProducer.joinable()) {
+        mProducer.join();
+    }
+    mQuery.reset();
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::iterator sqlite3_wrap::Sqlite3ReadAhead::begin()
+{
+    return Iterator(*this);
+}
+
+sqlite3_wrap::Sqlite3ReadAhead::iterator sqlite3_wrap::Sqlite3ReadAhead::end() const
+{
+    (void)this;
+    return Iterator();
+}
+
+void sqlite3_wrap::Sqlite3ReadAhead::produce()
+{
+    const size_t depth = mBatches.size();
+    size_t tail = 0;
+    int rc = SQLITE_ROW;
+    while (SQLITE_ROW == rc) {
+        int spins = 0;
+        while (tail - mHead.load(std::memory_order_acquire) >= depth) {
+            if (mStop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            backoff(spins);
+        }
+
+        Batch& batch = mBatches[tail % depth];
+        batch.rows = 0;
+        while (batch.rows < mBatchRows) {
+            if (mStop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            rc = mQuery.step();
+            if (SQLITE_ROW != rc) {
+                break;
+            }
+            const Sqlite3Query::Rows row(mQuery.mStmt);
+            auto value = batch.values.begin() + batch.rows * mColumns;
+            for (int i = 0; i < mColumns; ++i, ++value) {
+                *value = row.get<QVariant>(i);
+            }
+            ++batch.rows;
+        }
+        batch.rc = rc;
+        if (SQLITE_ROW != rc && SQLITE_DONE != rc) {
+            batch.error = mQuery.mDB.lastError();
+        }
+        mTail.store(++tail, std::memory_order_release);
+    }
+}
+
+bool sqlite3_wrap::Sqlite3ReadAhead::next()
+{
+    while (!mEnd) {
+        if (nullptr != mCurrent) {
+            if (++mRowIdx < mCurrent->rows) {
+                mRow.mValues = mCurrent->values.data() + mRowIdx * mColumns;
+                return true;
+            }
+            const int rc = mCurrent->rc;
+            const QString error = mCurrent->error;
+            mCurrent = nullptr;
+            mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            if (SQLITE_ROW != rc) {
+                mEnd = true;
+                if (SQLITE_DONE != rc) {
+                    throw std::runtime_error(error.toStdString());
+                }
+                break;
+            }
+        }
+
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        int spins = 0;
+        while (mTail.load(std::memory_order_acquire) == head) {
+            backoff(spins);
+        }
+        mCurrent = &mBatches[head % mBatches.size()];
+        mRowIdx = -1;
+    }
+
+    return false;
+}
+
 sqlite3_wrap::Sqlite3Transaction::Sqlite3Transaction(Sqlite3 & db, bool commit, bool freserve)
     : mDB(db), mCommit(commit), mFinished(false)
 {
@@ -578,3 +2363,106 @@ int sqlite3_wrap::Sqlite3Transaction::rollback() const
     return rc;
 }
 
+sqlite3_wrap::Sqlite3ChangeFeed::Sqlite3ChangeFeed(int capacity)
+    : mMask(0), mHead(0), mTail(0), mDropped(0), mWaiters(0)
+{
+    quint64 size = 2;
+    while (size < static_cast<quint64>(capacity)) {
+        size <<= 1;
+    }
+    mSlots.reset(new Slot[size]);
+    for (quint64 i = 0; i < size; ++i) {
+        mSlots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mMask = size - 1;
+}
+
+int sqlite3_wrap::Sqlite3ChangeFeed::capacity() const
+{
+    return static_cast<int>(mMask + 1);
+}
+
+quint64 sqlite3_wrap::Sqlite3ChangeFeed::dropped() const
+{
+    return mDropped.load();
+}
+
+bool sqlite3_wrap::Sqlite3ChangeFeed::poll(Sqlite3Change & change)
+{
+    quint64 pos = mTail.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = mSlots[pos & mMask];
+        const quint64 seq = slot.seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<qint64>(seq - (pos + 1));
+        if (0 == diff) {
+            if (mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                change = std::move(slot.change);
+                slot.seq.store(pos + mMask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = mTail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool sqlite3_wrap::Sqlite3ChangeFeed::wait(Sqlite3Change & change, int timeoutMs)
+{
+    if (poll(change)) {
+        return true;
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    QMutexLocker locker(&mWaitLocker);
+    ++mWaiters;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    bool ok = false;
+    for (;;) {
+        if (poll(change)) {
+            ok = true;
+            break;
+        }
+        if (timeoutMs < 0) {
+            mWaitCondition.wait(&mWaitLocker);
+            continue;
+        }
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+        mWaitCondition.wait(&mWaitLocker, static_cast<unsigned long>(remaining));
+    }
+    --mWaiters;
+
+    return ok;
+}
+
+bool sqlite3_wrap::Sqlite3ChangeFeed::publish(Sqlite3Change & change)
+{
+    const quint64 pos = mHead.load(std::memory_order_relaxed);
+    Slot& slot = mSlots[pos & mMask];
+    if (slot.seq.load(std::memory_order_acquire) != pos) {
+        ++mDropped;
+        return false;
+    }
+    slot.change = std::move(change);
+    slot.seq.store(pos + 1, std::memory_order_release);
+    mHead.store(pos + 1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void sqlite3_wrap::Sqlite3ChangeFeed::notify()
+{
+    // 与 wait() 中的 fence 配对: 要么消费者看到新数据, 要么这里看到等待者
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiters.load() > 0) {
+        QMutexLocker locker(&mWaitLocker);
+        mWaitCondition.wakeAll();
+    }
+}
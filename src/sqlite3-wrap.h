@@ -5,7 +5,14 @@
 #ifndef sqlite3_wrap_SQLITE_3_WRAP_H
 #define sqlite3_wrap_SQLITE_3_WRAP_H
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <QMutex>
 #include <QObject>
+#include <QVariant>
+#include <QStringList>
+#include <QWaitCondition>
 #include <sqlite3.h>
 
 namespace sqlite3_wrap
@@ -15,12 +22,163 @@ namespace sqlite3_wrap
     {
         using to_int = int;
     };
+    struct Sqlite3LockStatistics
+    {
+        quint64         acquisitions = 0;       // lockForWrite() 次数
+        quint64         waitNs = 0;             // 等待线程锁 + 进程锁的总耗时
+        quint64         maxWaitNs = 0;          // 单次最长等待
+    };
+
+    struct Sqlite3MaintenanceOptions
+    {
+        int             idleMs = 2000;                  // 距最近一次读写超过该时长才视为空闲
+        int             intervalMs = 1000;              // 检查周期
+        int             taskBudgetMs = 100;             // 单个任务的时间预算
+        qint64          walPassiveBytes = 4 << 20;      // WAL 超过该大小执行 PASSIVE checkpoint, <= 0 禁用
+        qint64          walTruncateBytes = 64 << 20;    // WAL 超过该大小执行 TRUNCATE checkpoint, <= 0 禁用
+        int             optimizeIntervalMs = 3600000;   // PRAGMA optimize 的最小间隔, <= 0 禁用
+        int             optimizeMask = 0x10002;         // 0x10000: 检查所有表, 而不只是本连接用过的表
+        int             vacuumPages = 64;               // 每批 incremental_vacuum 的页数, <= 0 禁用
+    };
+
+    struct Sqlite3MaintenanceTaskStatistics
+    {
+        quint64         runs = 0;
+        quint64         interrupted = 0;                // 超出时间预算被中断的次数
+        quint64         totalUs = 0;
+        quint64         lastUs = 0;
+        int             lastRc = SQLITE_OK;
+    };
+
+    struct Sqlite3MaintenanceStatistics
+    {
+        Sqlite3MaintenanceTaskStatistics    checkpoint;
+        Sqlite3MaintenanceTaskStatistics    optimize;
+        Sqlite3MaintenanceTaskStatistics    vacuum;
+        quint64                             checkpointedFrames = 0;
+        quint64                             vacuumedPages = 0;
+    };
+
+    struct Sqlite3ImmutableOptions
+    {
+        enum Preload
+        {
+            PreloadNone,
+            PreloadPageCache,                           // 顺序读一遍文件, 预热操作系统页缓存
+            PreloadMemory,                              // 整个文件读入内存, 通过 sqlite3_deserialize() 打开
+        };
+        qint64          mmapSize = 1LL << 30;           // PRAGMA mmap_size, 受编译期 SQLITE_MAX_MMAP_SIZE 限制
+        Preload         preload = PreloadNone;
+    };
+
+    struct Sqlite3HybridOptions
+    {
+        int             flushIntervalMs = 1000;         // 周期落盘间隔, 即崩溃时最多丢失的时长; <= 0 只在 flush()/disconnect() 时落盘
+        int             busyTimeoutMs = 5000;           // 内存库有未结束的写事务或磁盘文件被占用时的最长等待
+    };
+
+    /**
+     * @brief 按列选用的值压缩参数, 见 Sqlite3Statement::bindCompressed()
+     *
+     * 压缩后的值以 BLOB 存储, 格式与 qCompress() 相同 (4 字节大端原始长度 + zlib 流);
+     * 未压缩的值仍以 TEXT 存储, 列类型即是标记。
+     */
+    struct Sqlite3Codec
+    {
+        int             threshold = 512;                // UTF-8 字节数小于该值时原样存储
+        int             level = -1;                     // zlib 压缩级别, -1 为默认
+    };
+
+    /**
+     * @brief 每条不同 SQL 第一次 prepare 时捕获的 EXPLAIN QUERY PLAN, 以及 finish() 时累计的语句计数器
+     */
+    struct Sqlite3QueryPlan
+    {
+        enum Check
+        {
+            Off,                                        // 不检查 (默认)
+            Capture,                                    // 只记录计划与计数器
+            Warn,                                       // 热点语句出现全表扫描时 qWarning()
+            Strict,                                     // 热点语句出现全表扫描时 prepare 失败
+        };
+        QString         sql;
+        QStringList     steps;                          // EXPLAIN QUERY PLAN 的 detail 列
+        QStringList     fullScans;                      // 未使用索引的 SCAN 步骤
+        bool            tempBTree = false;              // 含 USE TEMP B-TREE (ORDER BY / GROUP BY / DISTINCT 无索引可用)
+        bool            hot = false;
+        quint64         prepares = 0;
+        quint64         fullScanSteps = 0;              // SQLITE_STMTSTATUS_FULLSCAN_STEP
+        quint64         sorts = 0;                      // SQLITE_STMTSTATUS_SORT
+        quint64         vmSteps = 0;                    // SQLITE_STMTSTATUS_VM_STEP
+    };
+
+    struct Sqlite3Change
+    {
+        enum Operation
+        {
+            Insert = SQLITE_INSERT,
+            Update = SQLITE_UPDATE,
+            Delete = SQLITE_DELETE,
+        };
+        Operation       op = Insert;
+        QString         database;
+        QString         table;
+        qint64          rowid = 0;              // 变更前的 rowid (Insert 时与 newRowid 相同)
+        qint64          newRowid = 0;
+        QVariantList    oldValues;              // 仅当 SQLite 以 SQLITE_ENABLE_PREUPDATE_HOOK 编译且订阅时要求取值
+        QVariantList    newValues;
+    };
+
+    /**
+     * @brief 已提交行变更的有界环形队列: 单生产者 (连接的 commit hook), 多消费者竞争消费
+     *
+     * @note 生产者从不阻塞: 队列满时新变更被丢弃并计入 dropped(), 下游据此决定是否全量重同步
+     */
+    class Sqlite3ChangeFeed
+    {
+        friend class Sqlite3Private;
+    public:
+        explicit Sqlite3ChangeFeed(int capacity);
+        Sqlite3ChangeFeed(const Sqlite3ChangeFeed&) = delete;
+        Sqlite3ChangeFeed& operator=(const Sqlite3ChangeFeed&) = delete;
+
+        int capacity() const;
+        quint64 dropped() const;
+
+        bool poll(Sqlite3Change& change);
+        /**
+         * @param timeoutMs 小于 0 表示一直等待
+         * @return 超时返回 false
+         */
+        bool wait(Sqlite3Change& change, int timeoutMs = -1);
+
+    private:
+        bool publish(Sqlite3Change& change);
+        void notify();
+
+    private:
+        struct Slot
+        {
+            std::atomic<quint64>        seq;
+            Sqlite3Change               change;
+        };
+        std::unique_ptr<Slot[]>         mSlots;
+        quint64                         mMask;
+        std::atomic<quint64>            mHead;                  // 生产者写入位置
+        std::atomic<quint64>            mTail;                  // 消费者读取位置
+        std::atomic<quint64>            mDropped;
+        std::atomic<int>                mWaiters;
+        QMutex                          mWaitLocker;            // 仅用于阻塞等待
+        QWaitCondition                  mWaitCondition;
+    };
+
     class Sqlite3Private;
     class Sqlite3 final : public QObject
     {
         Q_OBJECT
         Q_DECLARE_PRIVATE(Sqlite3)
         friend class Sqlite3Statement;
+        friend class Sqlite3WriteLocker;
     public:
         explicit Sqlite3(bool showSQL = false, QObject *parent = nullptr);
         ~Sqlite3() override;
@@ -33,14 +191,95 @@ namespace sqlite3_wrap
         int execute(char const* sql, ...);
         int connect(const QString& dbName);
 
+        /**
+         * @brief 以 immutable=1&mode=ro 打开随程序发布、运行期间不会被修改的只读数据库
+         *
+         * 不创建 /tmp 下的锁文件, 不使用 SQLite 文件锁, 读写接口也不再获取线程锁和进程锁;
+         * 所有写操作返回 SQLITE_READONLY, startMaintenance() 不可用。
+         *
+         * @note 文件在打开期间被修改会导致读到错误数据。多线程并发查询时建议每个线程一个 Sqlite3,
+         *       mmap 使它们共享操作系统页缓存; PreloadMemory 则每个连接各持有一份拷贝
+         */
+        int connectImmutable(const QString& dbName, const Sqlite3ImmutableOptions& options = Sqlite3ImmutableOptions());
+
+        /**
+         * @brief 主库放在内存中: 启动时用 backup API 从磁盘文件载入, 之后周期性或调用 flush() 时整体写回
+         *
+         * 写入只经过线程锁, 不再获取进程锁; 写回时持有线程锁用 sqlite3_serialize() 取一份内存快照,
+         * 再在磁盘连接上的单个事务内写出, 写入只被阻塞一次内存拷贝的时间。崩溃后磁盘文件
+         * 停留在上一次完整落盘的状态。disconnect() 时做最后一次落盘。
+         *
+         * @note 磁盘文件由本连接独占写入, 其它连接只应读取; startMaintenance() 不可用
+         */
+        int connectHybrid(const QString& dbName, const Sqlite3HybridOptions& options = Sqlite3HybridOptions());
+
+        /**
+         * @brief 立即把内存库写回磁盘, 仅在 connectHybrid() 打开时可用
+         */
+        int flush();
+
         bool checkTableIsExist(const QString& tableName);
         bool checkKeyExist(const QString& tableName, const QString& fieldName, qint64 key);
         bool checkKeyExist(const QString& tableName, const QString& fieldName, const QString& key);
 
+        /**
+         * @brief 在当前连接上注册虚拟表模块, 见 Sqlite3VTable
+         * @param destroy 模块被替换、连接关闭或注册失败时以 clientData 调用
+         * @note 模块随连接存在, 重新 connect 之后需要再次注册
+         */
+        int createModule(const QString& name, const sqlite3_module* module, void* clientData, void (*destroy)(void*) = nullptr);
+
+        Sqlite3LockStatistics lockStatistics() const;
+        void resetLockStatistics();
+
+        /**
+         * @brief 订阅已提交的行变更 (INSERT/UPDATE/DELETE), 回滚的事务、失败的语句以及 ROLLBACK TO 撤销的修改不会投递
+         * @param capacity 队列容量, 向上取整到 2 的幂
+         * @param withValues 是否携带旧/新列值, 需要 SQLite 以 SQLITE_ENABLE_PREUPDATE_HOOK 编译 (configure 时探测)
+         * @return withValues 为 true 但不支持 preupdate hook 时返回 nullptr
+         * @note 变更在完成提交的 execute()/step() 返回前投递, 提交失败 (例如 SQLITE_BUSY) 时继续保留到下次提交
+         */
+        std::shared_ptr<Sqlite3ChangeFeed> subscribeChanges(int capacity = 4096, bool withValues = false);
+        void unsubscribeChanges(const std::shared_ptr<Sqlite3ChangeFeed>& feed);
+
+        /**
+         * @brief 启动后台维护线程: 空闲时执行 WAL checkpoint、incremental_vacuum 与 PRAGMA optimize
+         * @note 维护线程使用独立连接, 写操作期间持有与 execute() 相同的线程锁和进程锁;
+         *       disconnect()/connect() 会停止维护线程, 需要时重新启动
+         */
+        int startMaintenance(const Sqlite3MaintenanceOptions& options = Sqlite3MaintenanceOptions());
+        void stopMaintenance();
+        Sqlite3MaintenanceStatistics maintenanceStatistics() const;
+
+        /**
+         * @brief 查询计划检查, 作用于本连接上所有 Sqlite3Statement 以及 checkKeyExist()
+         * @note Strict 模式下 prepare 失败返回 SQLITE_ERROR, 原因由 lastError() 给出
+         */
+        void setPlanCheck(Sqlite3QueryPlan::Check check);
+        void markHot(const QString& sql);
+        QList<Sqlite3QueryPlan> queryPlans() const;
+        void resetQueryPlans();
+
     private:
         std::shared_ptr<Sqlite3Private>         d_ptr = nullptr;
     };
 
+    /**
+     * @brief 在作用域内持有与 Sqlite3::execute() 相同的线程锁 + 进程锁, 用于串行化 Sqlite3Command 写入
+     * @note 持有期间不要在同一线程调用 execute()/checkTableIsExist() 等自身加锁的接口
+     */
+    class Sqlite3WriteLocker
+    {
+    public:
+        explicit Sqlite3WriteLocker(Sqlite3& db);
+        ~Sqlite3WriteLocker();
+        Sqlite3WriteLocker(const Sqlite3WriteLocker&) = delete;
+        Sqlite3WriteLocker& operator=(const Sqlite3WriteLocker&) = delete;
+
+    private:
+        Sqlite3&            mDB;
+    };
+
     class Sqlite3Statement
     {
     public:
@@ -65,6 +304,22 @@ namespace sqlite3_wrap
         int bind(const QString& name, long long int value) const;
         int bind(const QString& name, const QString& value) const;
 
+        int bindBlob(int idx, const QByteArray& value) const;
+        int bindBlob(const QString& name, const QByteArray& value) const;
+
+        /**
+         * @brief 超过 codec.threshold 且压缩后更小时按 BLOB 存储压缩数据, 否则与 bind(QString) 相同
+         * @note 用 Rows::getDecompressed() 或 SQL 函数 wrap_decompress() 读取
+         */
+        int bindCompressed(int idx, const QString& value, const Sqlite3Codec& codec = Sqlite3Codec()) const;
+        int bindCompressed(const QString& name, const QString& value, const Sqlite3Codec& codec = Sqlite3Codec()) const;
+
+        /**
+         * @brief 按 QVariant 的类型绑定, 无效的 QVariant 绑定为 NULL
+         */
+        int bindValue(int idx, const QVariant& value) const;
+        int bindValue(const QString& name, const QVariant& value) const;
+
         int step() const;
         int reset() const;
 
@@ -78,7 +333,8 @@ namespace sqlite3_wrap
     protected:
         Sqlite3&            mDB;
         sqlite3_stmt*       mStmt = nullptr;
-        char const*         mTail = nullptr;
+        char const*         mTail = nullptr;            // 指向 mSql 中剩余的语句
+        QByteArray          mSql;
     };
 
     class Sqlite3Command : public Sqlite3Statement
@@ -123,6 +379,7 @@ namespace sqlite3_wrap
 
     class Sqlite3Query : public Sqlite3Statement
     {
+        friend class Sqlite3ReadAhead;
     public:
         class Rows
         {
@@ -156,6 +413,11 @@ namespace sqlite3_wrap
                 return std::make_tuple(get(idxs, Ts())...);
             }
             GetStream getter(int idx = 0);
+
+            /**
+             * @brief 读取 bindCompressed() 写入的列: BLOB 解压, 其它类型按 get<QString>() 读取
+             */
+            QString getDecompressed(int idx) const;
         private:
             int get (int idx, int) const;
             double get(int idx, double) const;
@@ -163,6 +425,8 @@ namespace sqlite3_wrap
             char const* get (int idx, char const*) const;
             QString get (int idx, QString) const;
             void const* get (int idx, void const*) const;
+            QByteArray get (int idx, QByteArray) const;
+            QVariant get (int idx, QVariant) const;
 
         private:
             sqlite3_stmt*       mStmt = nullptr;
@@ -191,6 +455,152 @@ namespace sqlite3_wrap
         iterator end() const;
     };
 
+    /**
+     * @brief 键集分页游标, 代替 LIMIT ? OFFSET ?
+     *
+     * 每页执行 SELECT * FROM (query) WHERE (k1, k2) > (?, ?) ORDER BY k1, k2 LIMIT ?,
+     * 两条语句各只 prepare 一次, 深页与首页代价相同。
+     *
+     * @note keyColumns 必须是 query 的结果列名, 组合起来唯一 (通常以主键结尾);
+     *       query 本身不应包含 ORDER BY / LIMIT
+     */
+    class Sqlite3Cursor
+    {
+    public:
+        class Page
+        {
+            friend class Sqlite3Cursor;
+        public:
+            int rowCount() const;
+            int columnCount() const;
+            const QVariant& value(int row, int column) const;
+            template <class T> T get(int row, int column) const
+            {
+                return value(row, column).value<T>();
+            }
+        private:
+            int                         mRows = 0;
+            int                         mColumns = 0;
+            std::vector<QVariant>       mValues;                // 行优先, 跨页复用
+        };
+
+        Sqlite3Cursor(Sqlite3& db, const QString& query, const QStringList& keyColumns, int pageSize = 100, bool descending = false);
+
+        /**
+         * @brief 绑定 query 自身的参数, idx 从 1 开始; 需要在第一次 fetch() 之前调用
+         */
+        int bindValue(int idx, const QVariant& value);
+
+        /**
+         * @brief 读取下一页到 page 中 (复用 page 的缓冲区)
+         * @return 取到至少一行返回 true
+         * @throw std::runtime_error 执行失败时
+         */
+        bool fetch(Page& page);
+        bool atEnd() const;
+        void rewind();
+
+        /**
+         * @brief 当前位置的不透明令牌, 可在新的 Sqlite3Cursor 上 resume() 继续翻页
+         */
+        QByteArray resumeToken() const;
+        bool resume(const QByteArray& token);
+
+    private:
+        int bindKeys(Sqlite3Query& query) const;
+
+    private:
+        Sqlite3&                        mDB;
+        Sqlite3Query                    mFirstPage;
+        Sqlite3Query                    mNextPage;
+        QVariantList                    mBinds;                 // query 自身的参数
+        QVariantList                    mLastKey;
+        std::vector<int>                mKeyIndexes;
+        int                             mPageSize;
+        bool                            mAtEnd = false;
+    };
+
+    /**
+     * @brief 预读迭代: 生产者线程 step() 并把行解码成定长批次, 经有界无锁队列交给 range-for 的消费者
+     *
+     * SQLite 的读页与解码和每行的处理相互重叠, 适合单行处理较重的遍历。
+     *
+     * @note 存活期间 query 归生产者线程独占, 不要在别处 step()/reset(); 析构时停止生产者并 reset() query。
+     *       同一连接上的其它调用依赖 SQLite 的串行化模式 (默认)
+     */
+    class Sqlite3ReadAhead
+    {
+    public:
+        class Row
+        {
+            friend class Sqlite3ReadAhead;
+        public:
+            int columnCount() const;
+            const QVariant& value(int idx) const;
+            template <class T> T get(int idx) const
+            {
+                return value(idx).value<T>();
+            }
+        private:
+            const QVariant*     mValues = nullptr;
+            int                 mColumns = 0;
+        };
+        class Iterator : public std::iterator<std::input_iterator_tag, Row>
+        {
+        public:
+            Iterator();
+            explicit Iterator(Sqlite3ReadAhead& readAhead);
+            bool operator == (Iterator const& other) const;
+            bool operator != (Iterator const& other) const;
+            Iterator& operator ++ ();
+            const Row& operator * () const;
+        private:
+            Sqlite3ReadAhead*   mReadAhead;
+        };
+
+        /**
+         * @param batchRows 每批的行数
+         * @param depth 队列中最多缓存的批数
+         */
+        explicit Sqlite3ReadAhead(Sqlite3Query& query, int batchRows = 256, int depth = 4);
+        ~Sqlite3ReadAhead();
+        Sqlite3ReadAhead(const Sqlite3ReadAhead&) = delete;
+        Sqlite3ReadAhead& operator=(const Sqlite3ReadAhead&) = delete;
+
+        using iterator = Iterator;
+
+        /**
+         * @throw std::runtime_error step() 失败时 (在消费者一侧抛出)
+         */
+        iterator begin();
+        iterator end() const;
+
+    private:
+        struct Batch
+        {
+            std::vector<QVariant>       values;                 // 行优先, 预分配并复用
+            int                         rows = 0;
+            int                         rc = SQLITE_ROW;        // 非 SQLITE_ROW 表示这是最后一批
+            QString                     error;
+        };
+        void produce();
+        bool next();
+
+    private:
+        Sqlite3Query&                   mQuery;
+        const int                       mColumns;
+        const int                       mBatchRows;
+        std::vector<Batch>              mBatches;
+        std::atomic<size_t>             mHead;                  // 消费者已归还的批数
+        std::atomic<size_t>             mTail;                  // 生产者已发布的批数
+        std::atomic<bool>               mStop;
+        std::thread                     mProducer;
+        Batch*                          mCurrent = nullptr;
+        int                             mRowIdx = -1;
+        bool                            mEnd = false;
+        Row                             mRow;
+    };
+
     class Sqlite3Transaction
     {
     public: